@@ -6,6 +6,7 @@
 
 #include "command.h"
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -35,6 +36,34 @@ Command mk_generic_command(char** args) {
   return cmd;
 }
 
+// Builtins recognized by the name of the command rather than by a token
+static const struct {
+  const char* name;
+  CommandType type;
+  Command (*mk)(char**);
+} named_builtins[] = {
+  { "jobs", JOBS, mk_jobs_command },
+  { "hash", HASH, mk_hash_command },
+  { "wait", WAIT, mk_wait_command },
+  { "timeout", TIMEOUT, mk_timeout_command },
+  { "after", AFTER, mk_after_command },
+  { "parallel", PARALLEL, mk_parallel_command },
+  { "joblog", JOBLOG, mk_joblog_command },
+  { "jobprio", JOBPRIO, mk_jobprio_command },
+};
+
+#define NUM_NAMED_BUILTINS (sizeof(named_builtins) / sizeof(named_builtins[0]))
+
+// Create a GenericCommand or a builtin recognized by name
+Command mk_command_from_args(char** args) {
+  for (size_t i = 0; i < NUM_NAMED_BUILTINS; ++i) {
+    if (strcmp(args[0], named_builtins[i].name) == 0)
+      return named_builtins[i].mk(args + 1);
+  }
+
+  return mk_generic_command(args);
+}
+
 // Create EchoCommand
 Command mk_echo_command(char** strs) {
   Command cmd;
@@ -99,11 +128,109 @@ Command mk_pwd_command() {
 }
 
 // Create JobCommand structure
-Command mk_jobs_command() {
+Command mk_jobs_command(char** args) {
   Command cmd;
 
   cmd.jobs = (JobsCommand) {
-    JOBS
+    JOBS,
+    args
+  };
+
+  return cmd;
+}
+
+// Create AssignCommand structure
+Command mk_assign_command(char* env_var, char* val) {
+  Command cmd;
+
+  cmd.assign = (AssignCommand) {
+    ASSIGN,
+    env_var,
+    val
+  };
+
+  return cmd;
+}
+
+// Create HashCommand structure
+Command mk_hash_command(char** args) {
+  Command cmd;
+
+  cmd.hash = (HashCommand) {
+    HASH,
+    args
+  };
+
+  return cmd;
+}
+
+// Create WaitCommand structure
+Command mk_wait_command(char** args) {
+  Command cmd;
+
+  cmd.wait = (WaitCommand) {
+    WAIT,
+    args
+  };
+
+  return cmd;
+}
+
+// Create TimeoutCommand structure
+Command mk_timeout_command(char** args) {
+  Command cmd;
+
+  cmd.timeout = (TimeoutCommand) {
+    TIMEOUT,
+    args
+  };
+
+  return cmd;
+}
+
+// Create AfterCommand structure
+Command mk_after_command(char** args) {
+  Command cmd;
+
+  cmd.after = (AfterCommand) {
+    AFTER,
+    args
+  };
+
+  return cmd;
+}
+
+// Create ParallelCommand structure
+Command mk_parallel_command(char** args) {
+  Command cmd;
+
+  cmd.parallel = (ParallelCommand) {
+    PARALLEL,
+    args
+  };
+
+  return cmd;
+}
+
+// Create JobLogCommand structure
+Command mk_joblog_command(char** args) {
+  Command cmd;
+
+  cmd.joblog = (JobLogCommand) {
+    JOBLOG,
+    args
+  };
+
+  return cmd;
+}
+
+// Create JobPrioCommand structure
+Command mk_jobprio_command(char** args) {
+  Command cmd;
+
+  cmd.jobprio = (JobPrioCommand) {
+    JOBPRIO,
+    args
   };
 
   return cmd;
@@ -136,10 +263,161 @@ CommandType get_command_type(Command cmd) {
   return cmd.simple.type;
 }
 
+// Get the name of a builtin that only holds its arguments
+const char* get_named_builtin(Command cmd) {
+  for (size_t i = 0; i < NUM_NAMED_BUILTINS; ++i) {
+    if (get_command_type(cmd) == named_builtins[i].type)
+      return named_builtins[i].name;
+  }
+
+  return NULL;
+}
+
 CommandType get_command_holder_type(CommandHolder holder) {
   return get_command_type(holder.cmd);
 }
 
+static char* __copy_str(const char* str) {
+  return (str != NULL) ? strdup(str) : NULL;
+}
+
+// Copy a NULL terminated array of strings
+static char** __copy_args(char** args) {
+  if (args == NULL)
+    return NULL;
+
+  size_t n = 0;
+
+  while (args[n] != NULL)
+    ++n;
+
+  char** copy = malloc((n + 1) * sizeof(char*));
+
+  for (size_t i = 0; i < n; ++i)
+    copy[i] = strdup(args[i]);
+
+  copy[n] = NULL;
+
+  return copy;
+}
+
+static void __free_args(char** args) {
+  if (args == NULL)
+    return;
+
+  for (char** arg = args; *arg != NULL; ++arg)
+    free(*arg);
+
+  free(args);
+}
+
+// Copy the strings owned by a command
+static Command __copy_command(Command cmd) {
+  switch (get_command_type(cmd)) {
+  case GENERIC:
+  case ECHO:
+  case JOBS:
+  case HASH:
+  case WAIT:
+  case TIMEOUT:
+  case AFTER:
+  case PARALLEL:
+  case JOBLOG:
+  case JOBPRIO:
+    cmd.generic.args = __copy_args(cmd.generic.args);
+    break;
+
+  case EXPORT:
+  case ASSIGN:
+    cmd.export.env_var = __copy_str(cmd.export.env_var);
+    cmd.export.val = __copy_str(cmd.export.val);
+    break;
+
+  case CD:
+    cmd.cd.dir = __copy_str(cmd.cd.dir);
+    break;
+
+  case KILL:
+    cmd.kill.sig_str = __copy_str(cmd.kill.sig_str);
+    cmd.kill.job_str = __copy_str(cmd.kill.job_str);
+    break;
+
+  default:
+    break;
+  }
+
+  return cmd;
+}
+
+static void __free_command(Command cmd) {
+  switch (get_command_type(cmd)) {
+  case GENERIC:
+  case ECHO:
+  case JOBS:
+  case HASH:
+  case WAIT:
+  case TIMEOUT:
+  case AFTER:
+  case PARALLEL:
+  case JOBLOG:
+  case JOBPRIO:
+    __free_args(cmd.generic.args);
+    break;
+
+  case EXPORT:
+  case ASSIGN:
+    free(cmd.export.env_var);
+    free(cmd.export.val);
+    break;
+
+  case CD:
+    free(cmd.cd.dir);
+    break;
+
+  case KILL:
+    free(cmd.kill.sig_str);
+    free(cmd.kill.job_str);
+    break;
+
+  default:
+    break;
+  }
+}
+
+CommandHolder* copy_script(const CommandHolder* holders) {
+  size_t n = 0;
+
+  while (get_command_holder_type(holders[n]) != EOC)
+    ++n;
+
+  CommandHolder* copy = malloc((n + 1) * sizeof(CommandHolder));
+
+  for (size_t i = 0; i <= n; ++i) {
+    copy[i] = mk_command_holder(__copy_str(holders[i].redirect_in),
+                                __copy_str(holders[i].redirect_out),
+                                holders[i].flags,
+                                __copy_command(holders[i].cmd));
+  }
+
+  return copy;
+}
+
+void free_script(CommandHolder* holders) {
+  if (holders == NULL)
+    return;
+
+  for (size_t i = 0; ; ++i) {
+    free(holders[i].redirect_in);
+    free(holders[i].redirect_out);
+    __free_command(holders[i].cmd);
+
+    if (get_command_holder_type(holders[i]) == EOC)
+      break;
+  }
+
+  free(holders);
+}
+
 #ifdef DEBUG
 static void __print_generic_cmd(GenericCommand cmd) {
   if (cmd.args != NULL) {
@@ -155,10 +433,24 @@ static void __print_echo_cmd(EchoCommand cmd) {
   printf("%%ECHO%%");
 }
 
+static void __print_named_cmd(const char* name, GenericCommand cmd) {
+  putc('%', stdout);
+
+  for (size_t i = 0; name[i] != '\0'; ++i)
+    putc(toupper((unsigned char) name[i]), stdout);
+
+  printf("%% ");
+  __print_generic_cmd(cmd);
+}
+
 static void __print_export_cmd(ExportCommand cmd) {
   printf("%%EXPORT%% [VAR: %s] [VAL: %s]", cmd.env_var, cmd.val);
 }
 
+static void __print_assign_cmd(AssignCommand cmd) {
+  printf("%%ASSIGN%% [VAR: %s] [VAL: %s]", cmd.env_var, cmd.val);
+}
+
 static void __print_cd_cmd(CDCommand cmd) {
   printf("%%CD%% [DIR: %s]", cmd.dir);
 }
@@ -197,20 +489,23 @@ static void __print_command(Command cmd) {
     __print_simple_cmd("PWD");
     break;
 
-  case JOBS:
-    __print_simple_cmd("JOBS");
-    break;
-
   case EXIT:
     __print_simple_cmd("EXIT");
     break;
 
+  case ASSIGN:
+    __print_assign_cmd(cmd.assign);
+    break;
+
   case EOC:
     printf("--- EOC ---");
     break;
 
   default:
-    printf("{???}");
+    if (get_named_builtin(cmd) != NULL)
+      __print_named_cmd(get_named_builtin(cmd), cmd.generic);
+    else
+      printf("{???}");
   }
 }
 
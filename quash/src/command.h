@@ -39,6 +39,12 @@
  * @brief Flag bit indicating whether a @a GenericCommand should write to
  * a pipe
  */
+/**
+ * @def TIMED
+ *
+ * @brief Flag bit indicating whether the job a @a GenericCommand belongs to was
+ * prefixed with the time keyword
+ */
 /**
  * @def BACKGROUND
  *
@@ -46,6 +52,7 @@
  * the background
  */
 #define REDIRECT_IN     (0x01)
+#define TIMED           (0x02)
 #define REDIRECT_OUT    (0x04)
 #define REDIRECT_APPEND (0x08)
 #define PIPE_IN         (0x10)
@@ -69,7 +76,15 @@ typedef enum CommandType {
   CD,
   PWD,
   JOBS,
-  EXIT
+  EXIT,
+  HASH,
+  ASSIGN,
+  WAIT,
+  TIMEOUT,
+  AFTER,
+  PARALLEL,
+  JOBLOG,
+  JOBPRIO
 } CommandType;
 
 // Command Structures
@@ -130,7 +145,8 @@ typedef struct ExportCommand {
  */
 typedef struct CDCommand {
   CommandType type; /**< Type of command */
-  char* dir;        /**< Path to the directory we wish to change to */
+  char* dir;        /**< Path to the directory we wish to change to or NULL
+                         for HOME */
 } CDCommand;
 
 /**
@@ -154,11 +170,96 @@ typedef struct KillCommand {
 typedef SimpleCommand PWDCommand;
 
 /**
- * @brief Alias for @a SimpleCommand to denote a print jobs list
+ * @brief Alias for @a GenericCommand to denote a print jobs list
+ *
+ * @note The args array holds the options following the "jobs" name
+ *
+ * @sa GenericCommand, Command, Job
+ */
+typedef GenericCommand JobsCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command to inspect and manage
+ * the command path cache
+ *
+ * @note The args array holds the arguments following the "hash" name
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand HashCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that waits for
+ * background jobs to finish
+ *
+ * @note The args array holds the arguments following the "wait" name
+ *
+ * @sa GenericCommand, Command, Job
+ */
+typedef GenericCommand WaitCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command run with a deadline
+ *
+ * @note The args array holds the arguments following the "timeout" name: the
+ * options, the duration and then the command with its arguments
+ *
+ * @sa GenericCommand, Command, Job
+ */
+typedef GenericCommand TimeoutCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that starts once other
+ * jobs have succeeded
+ *
+ * @note The args array holds the arguments following the "after" name: the
+ * jobs as %N, "--" and then the command with its arguments
+ *
+ * @sa GenericCommand, Command, Job
+ */
+typedef GenericCommand AfterCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command run once for every
+ * input by a pool of workers
+ *
+ * @note The args array holds the arguments following the "parallel" name: the
+ * options, the command template and then ":::" and the inputs if they are not
+ * read from standard in
+ *
+ * @sa GenericCommand, Command, Job
+ */
+typedef GenericCommand ParallelCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that shows the
+ * captured output of a background job
+ *
+ * @note The args array holds the arguments following the "joblog" name
+ *
+ * @sa GenericCommand, Command, Job
+ */
+typedef GenericCommand JobLogCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that shows or changes
+ * the priority of a background job
+ *
+ * @note The args array holds the arguments following the "jobprio" name
+ *
+ * @sa GenericCommand, Command, Job
+ */
+typedef GenericCommand JobPrioCommand;
+
+/**
+ * @brief Alias for @a ExportCommand to denote a variable assignment
+ *
+ * Assignments placed in front of a job (i.e. `NAME=value cmd | cmd`) are
+ * exported to the environment of that job only.
  *
- * @sa SimpleCommand, Command, Job
+ * @sa ExportCommand, Command
  */
-typedef SimpleCommand JobsCommand;
+typedef ExportCommand AssignCommand;
 
 /**
  * @brief Alias for @a SimpleCommand to denote a termination of the program
@@ -183,7 +284,8 @@ typedef SimpleCommand EOCCommand;
  *
  * @sa get_command_type, SimpleCommand, GenericCommand, EchoCommand,
  * ExportCommand, CDCommand, KillCommand, PWDCommand, JobsCommand, ExitCommand,
- * EOCCommand
+ * EOCCommand, HashCommand, AssignCommand, WaitCommand, TimeoutCommand,
+ * AfterCommand, ParallelCommand, JobLogCommand, JobPrioCommand
  */
 typedef union Command {
   SimpleCommand simple;   /**< Read structure as a @a SimpleCommand */
@@ -196,6 +298,14 @@ typedef union Command {
   JobsCommand jobs;       /**< Read structure as a @a JobsCommand */
   ExitCommand exit;       /**< Read structure as a @a ExitCommand */
   EOCCommand eoc;         /**< Read structure as a @a EOCCommand */
+  HashCommand hash;       /**< Read structure as a @a HashCommand */
+  AssignCommand assign;   /**< Read structure as a @a AssignCommand */
+  WaitCommand wait;       /**< Read structure as a @a WaitCommand */
+  TimeoutCommand timeout; /**< Read structure as a @a TimeoutCommand */
+  AfterCommand after;     /**< Read structure as a @a AfterCommand */
+  ParallelCommand parallel; /**< Read structure as a @a ParallelCommand */
+  JobLogCommand joblog;   /**< Read structure as a @a JobLogCommand */
+  JobPrioCommand jobprio; /**< Read structure as a @a JobPrioCommand */
 } Command;
 
 /**
@@ -217,7 +327,8 @@ typedef struct CommandHolder {
                        *   - @a REDIRECT_APPEND
                        *   - @a PIPE_IN
                        *   - @a PIPE_OUT
-                       *   - @a BACKGROUND */
+                       *   - @a BACKGROUND
+                       *   - @a TIMED */
   Command cmd;        /**< A @a Command to hold */
 } CommandHolder;
 
@@ -243,6 +354,7 @@ typedef struct CommandHolder {
  *   - @a PIPE_IN
  *   - @a PIPE_OUT
  *   - @a BACKGROUND
+ *   - @a TIMED
  *
  * @param cmd The @a Command the CommandHolder should copy and hold on to
  *
@@ -265,6 +377,22 @@ CommandHolder mk_command_holder(char* redirect_in, char* redirect_out, char flag
  */
 Command mk_generic_command(char** args);
 
+/**
+ * @brief Create a @a GenericCommand, or the builtin command named by the first
+ * argument, and return a copy
+ *
+ * Builtins without a token of their own in the lexer are recognized here by
+ * name.
+ *
+ * @param args A NULL terminated array of strings. The first string is the
+ * name of the command.
+ *
+ * @return Copy of the constructed command as a @a Command
+ *
+ * @sa mk_generic_command(), Command
+ */
+Command mk_command_from_args(char** args);
+
 /**
  * @brief Create a @a EchoCommand structure and return a copy
  *
@@ -293,7 +421,7 @@ Command mk_export_command(char* env_var, char* val);
 /**
  * @brief Create a @a CDCommand structure and return a copy
  *
- * @param dir Path to the directory we wish to change to
+ * @param dir Path to the directory we wish to change to or NULL for HOME
  *
  * @return Copy of constructed CDCommand as a @a Command
  *
@@ -326,11 +454,111 @@ Command mk_pwd_command();
 /**
  * @brief Create a @a JobsCommand structure and return a copy
  *
+ * @param args A NULL terminated array of strings containing the options passed
+ * to jobs
+ *
  * @return Copy of constructed JobsCommand as a @a Command
  *
  * @sa Command, JobsCommand
  */
-Command mk_jobs_command();
+Command mk_jobs_command(char** args);
+
+/**
+ * @brief Create a @a AssignCommand structure and return a copy
+ *
+ * @param env_var Name of the variable to set
+ *
+ * @param val String that should be stored in @a env_var
+ *
+ * @return Copy of constructed AssignCommand as a @a Command
+ *
+ * @sa Command, AssignCommand
+ */
+Command mk_assign_command(char* env_var, char* val);
+
+/**
+ * @brief Create a @a HashCommand structure and return a copy
+ *
+ * @param args A NULL terminated array of strings containing the arguments
+ * passed to hash
+ *
+ * @return Copy of constructed HashCommand as a @a Command
+ *
+ * @sa Command, HashCommand
+ */
+Command mk_hash_command(char** args);
+
+/**
+ * @brief Create a @a WaitCommand structure and return a copy
+ *
+ * @param args A NULL terminated array of strings containing the arguments
+ * passed to wait
+ *
+ * @return Copy of constructed WaitCommand as a @a Command
+ *
+ * @sa Command, WaitCommand
+ */
+Command mk_wait_command(char** args);
+
+/**
+ * @brief Create a @a TimeoutCommand structure and return a copy
+ *
+ * @param args A NULL terminated array of strings containing the arguments
+ * passed to timeout
+ *
+ * @return Copy of constructed TimeoutCommand as a @a Command
+ *
+ * @sa Command, TimeoutCommand
+ */
+Command mk_timeout_command(char** args);
+
+/**
+ * @brief Create a @a AfterCommand structure and return a copy
+ *
+ * @param args A NULL terminated array of strings containing the arguments
+ * passed to after
+ *
+ * @return Copy of constructed AfterCommand as a @a Command
+ *
+ * @sa Command, AfterCommand
+ */
+Command mk_after_command(char** args);
+
+/**
+ * @brief Create a @a ParallelCommand structure and return a copy
+ *
+ * @param args A NULL terminated array of strings containing the arguments
+ * passed to parallel
+ *
+ * @return Copy of constructed ParallelCommand as a @a Command
+ *
+ * @sa Command, ParallelCommand
+ */
+Command mk_parallel_command(char** args);
+
+/**
+ * @brief Create a @a JobLogCommand structure and return a copy
+ *
+ * @param args A NULL terminated array of strings containing the arguments
+ * passed to joblog
+ *
+ * @return Copy of constructed JobLogCommand as a @a Command
+ *
+ * @sa Command, JobLogCommand
+ */
+Command mk_joblog_command(char** args);
+
+/**
+ * @brief Create a @a JobPrioCommand structure and return a copy
+ *
+ * @param args A NULL terminated array of strings containing the arguments
+ * passed to jobprio
+ *
+ * @return Copy of constructed JobPrioCommand as a @a Command
+ *
+ * @sa Command, JobPrioCommand
+ */
+Command mk_jobprio_command(char** args);
 
 /**
  * @brief Create a @a ExitCommand structure and return a copy
@@ -364,6 +592,19 @@ Command mk_eoc();
  */
 CommandType get_command_type(Command cmd);
 
+/**
+ * @brief Get the name of a builtin that holds nothing but its arguments, like
+ * jobs or hash
+ *
+ * @param cmd The command
+ *
+ * @return The name the builtin is run with, or NULL if @a cmd is another kind
+ * of command
+ *
+ * @sa mk_command_from_args()
+ */
+const char* get_named_builtin(Command cmd);
+
 /**
  * @brief Get the type of the @a Command in the @a CommandHolder
  *
@@ -379,6 +620,30 @@ CommandType get_command_type(Command cmd);
  */
 CommandType get_command_holder_type(CommandHolder holder);
 
+/**
+ * @brief Make a deep copy of a script
+ *
+ * Scripts built by the parser live in the memory pool, which is emptied once
+ * the script has run. A copy outlives it, e.g. for a job that is started
+ * later.
+ *
+ * @param holders @a CommandHolder array terminated by an @a EOC command
+ *
+ * @return A copy of @a holders that must be free'd with free_script()
+ *
+ * @sa free_script(), CommandHolder
+ */
+CommandHolder* copy_script(const CommandHolder* holders);
+
+/**
+ * @brief Free a script made by copy_script()
+ *
+ * @param holders The copied script or NULL
+ *
+ * @sa copy_script()
+ */
+void free_script(CommandHolder* holders);
+
 /**
  * @brief Print all commands in the script with @a print_command()
  *
@@ -0,0 +1,197 @@
+/**
+ * @file cpu_placement.c
+ *
+ * @brief Implements the placement of processes on CPUs
+ */
+
+// cpu_set_t and sched_setaffinity()
+#define _GNU_SOURCE
+
+#include "cpu_placement.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "execute.h"
+
+struct CpuPlacement {
+  cpu_set_t cpus; // CPUs the processes of the job may use
+  int count;      // Number of CPUs in cpus
+  bool pin;       // Pin each stage to a single CPU
+  int next;       // Position in cpus of the next pinned stage of the job
+};
+
+// Position in the CPU set where the block of the next pinned job starts
+static int next_block = 0;
+
+static cpu_set_t saved_affinity;
+static bool affinity_saved = false;
+
+// Parse a CPU list like "0-3,6". Returns false if it is malformed.
+static bool __parse_cpu_list(const char* str, cpu_set_t* set) {
+  CPU_ZERO(set);
+
+  while (*str != '\0') {
+    char* end;
+
+    if (!isdigit((unsigned char) *str))
+      return false;
+
+    long first = strtol(str, &end, 10);
+    long last = first;
+
+    if (*end == '-') {
+      str = end + 1;
+
+      if (!isdigit((unsigned char) *str))
+        return false;
+
+      last = strtol(str, &end, 10);
+    }
+
+    if (last < first || last >= CPU_SETSIZE)
+      return false;
+
+    for (long cpu = first; cpu <= last; ++cpu)
+      CPU_SET(cpu, set);
+
+    if (*end == ',')
+      ++end;
+    else if (*end != '\0')
+      return false;
+
+    str = end;
+  }
+
+  return true;
+}
+
+// Get the CPU at a position of the set
+static int __nth_cpu(const cpu_set_t* set, int n) {
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, set) && n-- == 0)
+      return cpu;
+  }
+
+  return -1;
+}
+
+CpuPlacement* new_cpu_placement(size_t num_stages) {
+  const char* list = lookup_env("QUASH_CPUSET");
+  const char* policy = lookup_env("QUASH_CPU_PLACEMENT");
+  bool confine = list != NULL && *list != '\0';
+  bool pin = policy != NULL && strcmp(policy, "adjacent") == 0;
+
+  if (policy != NULL && *policy != '\0' && !pin && strcmp(policy, "none") != 0) {
+    fprintf(stderr, "ERROR: Invalid QUASH_CPU_PLACEMENT %s. Use adjacent or none\n", policy);
+    return NULL;
+  }
+
+  if (!confine && !pin)
+    return NULL;
+
+  CpuPlacement* placement = malloc(sizeof(CpuPlacement));
+  cpu_set_t allowed;
+
+  placement->pin = pin;
+
+  // Only the CPUs quash may use itself can be handed out
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    CPU_ZERO(&allowed);
+
+  if (confine) {
+    cpu_set_t requested;
+
+    if (!__parse_cpu_list(list, &requested)) {
+      fprintf(stderr, "ERROR: Invalid QUASH_CPUSET %s\n", list);
+      free(placement);
+      return NULL;
+    }
+
+    CPU_AND(&placement->cpus, &requested, &allowed);
+  }
+  else {
+    placement->cpus = allowed;
+  }
+
+  placement->count = CPU_COUNT(&placement->cpus);
+
+  if (placement->count == 0) {
+    fprintf(stderr, "ERROR: QUASH_CPUSET %s has no CPU quash may use\n", list);
+    free(placement);
+    return NULL;
+  }
+
+  // Each job gets its own run of CPUs, even if the stages of several jobs are
+  // started in turn
+  if (pin) {
+    placement->next = next_block % placement->count;
+    next_block = (placement->next + num_stages) % placement->count;
+  }
+
+  return placement;
+}
+
+int next_stage_cpu(CpuPlacement* placement) {
+  if (!placement->pin)
+    return -1;
+
+  return __nth_cpu(&placement->cpus, placement->next++ % placement->count);
+}
+
+bool set_stage_affinity(const CpuPlacement* placement, int cpu) {
+  cpu_set_t one;
+  const cpu_set_t* set = &placement->cpus;
+
+  if (cpu != -1) {
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    set = &one;
+  }
+
+  return sched_setaffinity(0, sizeof(cpu_set_t), set) == 0;
+}
+
+void save_affinity() {
+  affinity_saved = sched_getaffinity(0, sizeof(saved_affinity), &saved_affinity) == 0;
+}
+
+void restore_affinity() {
+  if (affinity_saved && sched_setaffinity(0, sizeof(saved_affinity), &saved_affinity) == -1)
+    fprintf(stderr, "ERROR: Failed to restore the CPU affinity of quash. Error #%d\n", errno);
+
+  affinity_saved = false;
+}
+
+void format_cpu_placement(const CpuPlacement* placement, char* buf, size_t len) {
+  size_t used = 0;
+
+  buf[0] = '\0';
+
+  // Runs of consecutive CPUs are written as ranges
+  for (int cpu = 0; cpu < CPU_SETSIZE && used < len; ++cpu) {
+    if (!CPU_ISSET(cpu, &placement->cpus))
+      continue;
+
+    int last = cpu;
+
+    while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &placement->cpus))
+      ++last;
+
+    const char* sep = (used > 0) ? "," : "";
+
+    if (last > cpu)
+      used += snprintf(buf + used, len - used, "%s%d-%d", sep, cpu, last);
+    else
+      used += snprintf(buf + used, len - used, "%s%d", sep, cpu);
+
+    cpu = last;
+  }
+
+  if (placement->pin && used < len)
+    snprintf(buf + used, len - used, " adjacent");
+}
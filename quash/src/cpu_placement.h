@@ -0,0 +1,88 @@
+/**
+ * @file cpu_placement.h
+ *
+ * @brief Places the processes of a job on CPUs
+ *
+ * By default the kernel may run every stage of a pipeline anywhere. Setting
+ * QUASH_CPUSET to a list like "0-3,6" confines the processes of new jobs to
+ * those CPUs, and setting QUASH_CPU_PLACEMENT to "adjacent" pins consecutive
+ * stages to consecutive CPUs of the set, so a producer and its consumer share
+ * caches. The placement is applied in the new process before it runs the
+ * program.
+ */
+
+#ifndef SRC_CPU_PLACEMENT_H
+#define SRC_CPU_PLACEMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief The CPUs a job may use and whether its stages are pinned
+ */
+typedef struct CpuPlacement CpuPlacement;
+
+/**
+ * @brief Create the placement for a new job from QUASH_CPUSET and
+ * QUASH_CPU_PLACEMENT
+ *
+ * When stages are pinned, the job is given the next @a num_stages consecutive
+ * CPUs of the set, wrapping around at its end, so that the stages of different
+ * jobs do not take turns on the same CPUs.
+ *
+ * @param num_stages Number of stages of the job
+ *
+ * @return A placement to free with free() or NULL if neither is set or they
+ * are invalid
+ */
+CpuPlacement* new_cpu_placement(size_t num_stages);
+
+/**
+ * @brief Choose the CPU of the next stage of a job
+ *
+ * Stages are handed consecutive CPUs of the block reserved for the job by
+ * new_cpu_placement().
+ *
+ * @param placement The placement of the job
+ *
+ * @return The CPU to pin the stage to or -1 if stages are not pinned
+ */
+int next_stage_cpu(CpuPlacement* placement);
+
+/**
+ * @brief Apply a placement to the calling process
+ *
+ * @param placement The placement of the job
+ *
+ * @param cpu The CPU returned by next_stage_cpu()
+ *
+ * @return True on success
+ */
+bool set_stage_affinity(const CpuPlacement* placement, int cpu);
+
+/**
+ * @brief Remember the CPUs quash itself may run on
+ *
+ * posix_spawn() has no way to set the affinity of the new process, but the
+ * process inherits quash's. Quash takes the placement of a stage while
+ * spawning it and then goes back with restore_affinity().
+ */
+void save_affinity();
+
+/**
+ * @brief Let quash run on the CPUs remembered by save_affinity() again
+ */
+void restore_affinity();
+
+/**
+ * @brief Describe a placement for job listings, like "0-3 adjacent"
+ *
+ * @param placement The placement of the job
+ *
+ * @param buf Buffer receiving the description
+ *
+ * @param len Size of @a buf
+ */
+void format_cpu_placement(const CpuPlacement* placement, char* buf, size_t len);
+
+#endif
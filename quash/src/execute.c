@@ -7,21 +7,36 @@
  * @note As you add things to this file you may want to change the method signature
  */
 
+// pipe2(), close_range(), posix_spawn_file_actions_addclosefrom_np() and
+// posix_spawn_file_actions_addtcsetpgrp_np()
+#define _GNU_SOURCE
+
 #include "execute.h"
 #include "string.h"
 
 #include <stdio.h>
 
 #include "parsing_interface.h"
+#include "cpu_placement.h"
+#include "path_cache.h"
+#include "priority.h"
+#include "variables.h"
 
 #include <sys/wait.h>
 #include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
 #include <signal.h>
-#include "list.h"
+#include <poll.h>
+#include <spawn.h>
+#include "deque.h"
+#include "jobs.h"
 
 #define P_READ 0
 #define P_WRITE 1
 
+#define CLOSE_RANGE_MAX (~0U)
+
 // Remove this and all expansion calls to it
 /**
  * @brief Note calls to any function that requires implementation
@@ -29,46 +44,61 @@
 #define IMPLEMENT_ME()                                                  \
   fprintf(stderr, "IMPLEMENT ME: %s(line %d): %s()\n", __FILE__, __LINE__, __FUNCTION__)
 
-#define MAX_SIZE 1024
+// Seconds a job that outlived its timeout gets between TERM and KILL
+#define DEFAULT_KILL_GRACE 2.0
 
-//the signal for killing a process. Its value is determined by run_kill
-static int kill_signal = -2;
+// Exit status of a timeout that could not run its command
+#define TIMEOUT_USAGE_STATUS 125
 
-typedef struct Job{
-  int job_id;  //id for the job
-  List pid_list; //the process ids of the processes in the job
-  char* cmd_input; //received cmd command for the job
-  int job_pipe[2][2];
-  int prev_pipe;
-  int next_pipe;
-} Job;
+/**
+ * @brief The descriptors one stage of a pipeline uses for standard in and out
+ *
+ * Every descriptor is opened close-on-exec and belongs to exactly one stage,
+ * so quash can close it as soon as that stage has been launched.
+ */
+typedef struct StageFds {
+  int in;  /**< Descriptor for standard in or -1 to inherit quash's */
+  int out; /**< Descriptor for standard out or -1 to inherit quash's */
+  int err; /**< Descriptor for standard error or -1 to inherit quash's */
+  bool ok; /**< False if a redirect could not be opened. The stage is not
+            * launched. */
+} StageFds;
 
-List job_list = {NULL, NULL, 0};
+/**
+ * @brief A variable as it was before an assignment in front of a job
+ */
+typedef struct SavedVar {
+  char* val;     /**< The previous value or NULL if the variable was unset */
+  bool exported; /**< The variable was exported */
+} SavedVar;
 
-//removes a job whose processes have all terminated
-void remove_job(Job* job){
-  assert(job != NULL);
-  if(job->cmd_input)
-    free(job->cmd_input);
-  free(job);
-}
+// Exit status of the last foreground job, expanded by $?
+static int last_exit_status = 0;
+
+// Exit status of the last builtin. Builtins set it when they fail.
+static int builtin_status = 0;
+
+// Ids of the background jobs waiting for a free slot, in the order they were
+// queued
+IMPLEMENT_DEQUE_STRUCT(PendingQueue, int);
+IMPLEMENT_DEQUE(PendingQueue, int);
+static PendingQueue pending_jobs = { NULL, 0, 0, 0, NULL };
+
+// Ids of the background jobs started with after that wait for other jobs
+static PendingQueue blocked_jobs = { NULL, 0, 0, 0, NULL };
 
-//removes a job and kills all of its ongoing processes
-void kill_job_with_processes(Job* job){
+static void start_pending_jobs();
+static void report_completed_job(const Job* job);
+
+//signals every ongoing process of a job. The job stays in the job table,
+//hidden, until its processes have been reaped
+static void kill_job(Job* job, int signal){
   assert(job != NULL);
-  pid_t pid;
-  //remove all processes in the job
-  while(!is_empty(&job->pid_list)){
-    pid = *(pid_t*)peek_back(&job->pid_list);
-    if(kill(pid, kill_signal) == -1){
-      fprintf(stderr, "Failed to kill process %d running under job %d. Error no. %d\n", job->job_id, pid, errno );
-    }
-    remove_from_back(&job->pid_list, &free); //get rid of the pid from the pid list
+  //one signal reaches every process of the job, including their descendants
+  if(killpg(job->pgid, signal) == -1){
+    fprintf(stderr, "Failed to kill process group %d running under job %d. Error no. %d\n", job->pgid, job->job_id, errno );
   }
-  //remove the job
-  if(job->cmd_input)
-    free(job->cmd_input);
-  free(job);
+  job->killed = true;
 }
 
 
@@ -78,52 +108,82 @@ void kill_job_with_processes(Job* job){
 
 // Return a string containing the current working directory.
 char* get_current_directory(bool* should_free) {
-  char* current_dir = malloc(sizeof(char)*MAX_SIZE);
-	return getcwd(current_dir,MAX_SIZE);
+  if (should_free != NULL)
+    *should_free = false;
 
+  return (char*) get_physical_directory();
 }
 
 // Returns the value of an environment variable env_var
 const char* lookup_env(const char* env_var) {
-  return getenv(env_var);
+  return lookup_variable(env_var);
+}
+
+// Returns the value of a variable whose name is not null terminated
+const char* lookup_n_env(const char* env_var, size_t len) {
+  return lookup_n_variable(env_var, len);
+}
+
+// Sets and exports an environment variable in quash's variable table
+void write_env(const char* env_var, const char* val) {
+  export_variable(env_var, val);
+
+  // Every cached command location may be stale now
+  if (strcmp(env_var, "PATH") == 0)
+    clear_path_cache();
+}
+
+// Sets a shell variable in quash's variable table
+void assign_env(const char* env_var, const char* val) {
+  set_variable(env_var, val);
+
+  if (strcmp(env_var, "PATH") == 0)
+    clear_path_cache();
+}
+
+// Removes a variable from quash's variable table
+static void unset_env(const char* env_var) {
+  unset_variable(env_var);
+
+  if (strcmp(env_var, "PATH") == 0)
+    clear_path_cache();
+}
+
+
+// Get the exit status of the last foreground job
+int get_last_exit_status() {
+  return last_exit_status;
+}
+
+// Get a descriptor that becomes readable when a child process exits
+int get_job_event_fd() {
+  return get_reap_fd();
 }
 
+// Reap every child that has exited without blocking
+bool reap_children() {
+  while(reap_exited_processes(0) > 0);
+
+  start_pending_jobs();
+
+  return num_unreported_jobs() > 0;
+}
 
 // Check the status of background jobs
 void check_jobs_bg_status() {
     
-    int status;
-    bool all_processes_completed;
-    pid_t pid, back_pid, pid_state;
-    Node *pid_node_next , *job_node_next;
-    for(Node *job_node = job_list.back; job_node != NULL ;){ //traverse the job list
-      all_processes_completed = true;
-      back_pid = *(pid_t*)peek_back(&((Job*)peek(job_node))->pid_list); 
-      for(Node* pid_node = ((Job*)peek(job_node))->pid_list.back; pid_node != NULL;){ //traverse the pid list (in each job)
-        pid = *(pid_t*)peek(pid_node);
-        pid_state = waitpid(pid, &status, WNOHANG);
-        pid_node_next = pid_node->next_node;
-        if(pid_state == pid){
-          remove_node( &((Job*)peek(job_node))->pid_list , pid_node, &free); //child pid is done. remove from pid queue
-        }
-        else if(pid_state == -1){ //child encountered an error, job is complete, but with errors
-          remove_node( &((Job*)peek(job_node))->pid_list , pid_node, &free);
-          fprintf(stderr,"An error occured in Job %d. Child Process %d returned error code %d.\n", ((Job*)peek(job_node))->job_id, pid, errno); //error handling
-          fflush(stderr);
-        }
-        else{
-          //child process is still running, so job is incomplete
-          all_processes_completed = false;
-        }
-        pid_node = pid_node_next;
-      }
+    reap_children();
 
-      job_node_next = job_node->next_node;
-      if(all_processes_completed){ //all children are finished, so the job is done. remove it from the job list.
-        print_job_bg_complete(((Job*)peek(job_node))->job_id, back_pid, ((Job*)peek(job_node))->cmd_input); 
-        remove_node(&job_list, job_node, (void*)remove_job);   //frees the job 
+    //nothing finished since the last check, so there is nothing to report
+    if(num_finished_jobs() == 0)
+      return;
+
+    for(Job* job = next_background_job(NULL); job != NULL; job = next_background_job(job)){ //traverse the job table
+      if(job->finished){ //all children are finished, so the job is done. remove it from the job table.
+        if(!job->killed) //a killed job was reported when it was killed
+          report_completed_job(job);
+        release_job(job);
       }
-      job_node = job_node_next;
     }
     
 }
@@ -141,12 +201,68 @@ void print_job_bg_start(int job_id, pid_t pid, const char* cmd) {
   print_job(job_id, pid, cmd);
 }
 
+// Prints a job that is waiting for a free background slot or for the jobs it
+// was started after
+static void print_pending_job(const Job* job) {
+  printf("[%d]\t%8s\t%s\n", job->job_id, (job->num_after > 0) ? "blocked" : "queued", job->cmd_input);
+  fflush(stdout);
+}
+
 // Prints a completion message followed by the print job
 void print_job_bg_complete(int job_id, pid_t pid, const char* cmd) {
   printf("Completed: \t");
   print_job(job_id, pid, cmd);
 }
 
+static inline double seconds(struct timeval tv) {
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Prints the resources a job has used so far: wall time, CPU time summed over
+// its reaped processes, the largest resident set and the voluntary and
+// involuntary context switches
+static void print_job_usage(const Job* job) {
+  printf("\twall %.3fs user %.3fs sys %.3fs maxrss %ldK ctxsw %ld/%ld\n",
+         job_wall_time(job),
+         seconds(job->usage.ru_utime), seconds(job->usage.ru_stime),
+         job->usage.ru_maxrss, job->usage.ru_nvcsw, job->usage.ru_nivcsw);
+  fflush(stdout);
+}
+
+// Prints the report of a job run under the time keyword to standard error:
+// the totals followed by one line for each stage
+static void print_job_times(const Job* job) {
+  fprintf(stderr, "\nreal\t%.3fs\nuser\t%.3fs\nsys\t%.3fs\n",
+          job_wall_time(job), seconds(job->usage.ru_utime), seconds(job->usage.ru_stime));
+
+  for (size_t i = 0; i < job->num_procs; ++i) {
+    const Process* proc = &job->procs[i];
+
+    fprintf(stderr, "stage %zu\t%8d\tuser %.3fs sys %.3fs maxrss %ldK\n",
+            i + 1, proc->pid, seconds(proc->usage.ru_utime), seconds(proc->usage.ru_stime),
+            proc->usage.ru_maxrss);
+  }
+}
+
+// Check if QUASH_ACCOUNTING asks for the usage of completed jobs
+static bool accounting_enabled() {
+  const char* str = lookup_env("QUASH_ACCOUNTING");
+
+  return str != NULL && *str != '\0' && strcmp(str, "0") != 0;
+}
+
+// Prints the completion message of a finished job, with its usage when
+// accounting is enabled
+static void report_completed_job(const Job* job) {
+  print_job_bg_complete(job->job_id, job->pgid, job->cmd_input);
+
+  if (accounting_enabled())
+    print_job_usage(job);
+
+  if (job->timed)
+    print_job_times(job);
+}
+
 /***************************************************************************
  * Functions to process commands
  ***************************************************************************/
@@ -158,10 +274,24 @@ void run_generic(GenericCommand cmd) {
   // in the array is the executable
   char* exec = cmd.args[0];
   char** args = cmd.args;
-  //printf("process %d about to execvp on %s\n", getpid(), cmd.args[0]);
-  execvp(exec, args);
-  fprintf(stderr, "ERROR: Failed to execute %s. Error #%d\n", exec, errno);
-  exit(EXIT_FAILURE);
+  const char* path = resolve_command_path(exec);
+  int err = ENOENT;
+
+  if (path != NULL) {
+    execve(path, args, get_envp());
+    err = errno;
+
+    // The program may have moved since its path was cached
+    if (err == ENOENT && (path = rehash_command_path(exec)) != NULL) {
+      execve(path, args, get_envp());
+      err = errno;
+    }
+  }
+
+  fprintf(stderr, "ERROR: Failed to execute %s. Error #%d\n", exec, err);
+
+  // Like other shells, a command that can't be found exits with 127
+  exit((err == ENOENT) ? 127 : EXIT_FAILURE);
 }
 
 // Print strings
@@ -172,7 +302,7 @@ void run_echo(EchoCommand cmd) {
 
   (void) str; // Silence unused variable warning
 
-  for(; *str != '\0'; ++str ){
+  for(; *str != NULL; ++str ){
     printf("%s ", *str);
   }
   printf("\n");
@@ -186,37 +316,78 @@ void run_export(ExportCommand cmd) {
   const char* env_var = cmd.env_var;
   const char* val = cmd.val;
 
-  if(setenv(env_var,val,1) == -1){
-    fprintf(stderr,"Error: Failed to update the %s environment variable to %s. Error #%d\n",env_var,val,errno);
-    exit(EXIT_FAILURE);  
+  // `export NAME` exports the value the variable already has
+  if (val == NULL)
+    val = lookup_env(env_var);
+
+  write_env(env_var, (val != NULL) ? val : "");
+}
+
+// Join a cd argument to the logical working directory and drop its "." and
+// ".." components without touching the file system, like other shells do
+static char* logical_path(const char* cwd, const char* dir) {
+  size_t len = strlen(cwd) + strlen(dir) + 2;
+  char* joined = malloc(len);
+  char* path = malloc(len + 1);
+  size_t n = 0;
+
+  if (dir[0] == '/')
+    strcpy(joined, dir);
+  else
+    snprintf(joined, len, "%s/%s", cwd, dir);
+
+  path[0] = '\0';
+
+  for (char* comp = strtok(joined, "/"); comp != NULL; comp = strtok(NULL, "/")) {
+    if (strcmp(comp, ".") == 0)
+      continue;
+
+    if (strcmp(comp, "..") == 0) {
+      char* slash = strrchr(path, '/');
+
+      n = (slash != NULL) ? (size_t) (slash - path) : 0;
+      path[n] = '\0';
+      continue;
+    }
+
+    n += sprintf(path + n, "/%s", comp);
   }
+
+  if (n == 0)
+    strcpy(path, "/");
+
+  free(joined);
+  return path;
 }
 
 // Changes the current working directory
 void run_cd(CDCommand cmd) {
-  // Get the directory name
-  const char* dir = cmd.dir;
+  // Get the directory name. cd on its own goes home.
+  const char* dir = (cmd.dir != NULL) ? cmd.dir : lookup_env("HOME");
 
   // Check if the directory is valid
   if (dir == NULL) {
-    fprintf(stderr,"Error: Failed to resolve path. Error #%d\n",errno);
-    exit(EXIT_FAILURE);  
+    fprintf(stderr, "Error: Failed to resolve path. HOME is not set\n");
+    builtin_status = 1;
+    return;
   }
-  char* cwd = get_current_directory(NULL);
 
-  setenv("PREV_PWD", cwd ,1);
+  char* logical = logical_path(get_logical_directory(), dir);
 
-  if(chdir(cmd.dir) == -1){
-    fprintf(stderr,"Error: Failed to go to %s. Error #%d\n",cmd.dir,errno);
-    exit(EXIT_FAILURE);
-  }
-  free(cwd);
-  cwd = get_current_directory(NULL);
-  if(setenv("PWD",cwd,1) == -1){
-    fprintf(stderr,"Error: Failed to update the PWD environment variable to %s. Error #%d\n",cwd,errno);
-    exit(EXIT_FAILURE);
+  // The only walk over the components of the path
+  char* physical = realpath(logical, NULL);
+
+  if (physical == NULL || chdir(physical) == -1) {
+    fprintf(stderr, "Error: Failed to go to %s. Error #%d\n", dir, errno);
+    free(logical);
+    free(physical);
+    builtin_status = 1;
+    return;
   }
-  free(cwd);    
+
+  write_env("PREV_PWD", get_logical_directory());
+  write_env("PWD", logical);
+  set_working_directory(logical, physical);
 }
 
 // Sends a signal to all processes contained in a job
@@ -224,32 +395,426 @@ void run_kill(KillCommand cmd) {
   int signal = cmd.sig;
   int job_id = cmd.job;
 
+  Job* job = get_job(job_id);
+
   //check if job is running
-  for(Node* job_node = job_list.back; job_node != NULL; job_node = job_node->next_node){   
-    if(((Job*)peek(job_node))->job_id == job_id){ //find the job in the job list
-      kill_signal = signal;
-      print_job_bg_complete(job_id, *(pid_t*)peek(((Job*)peek(job_node))->pid_list.back), (char*)((Job*)peek(job_node))->cmd_input);
-      remove_node(&job_list, job_node, (void*)kill_job_with_processes);
-      break;
+  if(job != NULL && job_id != FOREGROUND_JOB_ID && !job->killed){
+    if(job->pending){
+      //nothing to signal. The job is dropped when it leaves the queue
+      printf("Completed: \t");
+      print_pending_job(job);
+      job->killed = true;
+      return;
     }
+    print_job_bg_complete(job_id, job->pgid, job->cmd_input);
+    kill_job(job, signal);
+  }
+  else {
+    fprintf(stderr, "kill: %%%d: no such job\n", job_id);
+    builtin_status = 1;
+  }
+}
+
+
+// Check if a background job is still queued or running
+static bool have_background_work() {
+  return num_running_jobs() > 0 ||
+    (pending_jobs.data != NULL && !is_empty_PendingQueue(&pending_jobs)) ||
+    (blocked_jobs.data != NULL && !is_empty_PendingQueue(&blocked_jobs));
+}
+
+// Block until a child exits, then start the queued jobs it made room for
+static bool wait_for_exit() {
+  if (reap_exited_processes(-1) == -1 && errno != EINTR) {
+    fprintf(stderr, "wait: Error #%d\n", errno);
+    return false;
+  }
+
+  start_pending_jobs();
+  return true;
+}
+
+// Find a background job that finished and has not been reported yet
+static Job* find_finished_job() {
+  if (num_unreported_jobs() == 0)
+    return NULL;
+
+  for (Job* job = next_background_job(NULL); job != NULL; job = next_background_job(job)) {
+    if (job->finished && !job->killed)
+      return job;
+  }
+
+  return NULL;
+}
+
+// Report a job wait returns for and remove it from the job table
+static int finish_waited_job(Job* job) {
+  int status = job->exit_status;
+
+  report_completed_job(job);
+  release_job(job);
+
+  return status;
+}
+
+// Wait for one job given as %N
+static int wait_for_job_id(const char* arg) {
+  char* end;
+  long job_id = strtol(arg + 1, &end, 10);
+  Job* job = (*end == '\0' && end != arg + 1) ? get_job(job_id) : NULL;
+
+  if (job == NULL || job_id == FOREGROUND_JOB_ID || job->killed) {
+    fprintf(stderr, "wait: %s: no such job\n", arg);
+    return 127;
+  }
+
+  start_pending_jobs();
+
+  // The slot is released if the job could not be launched when it left the
+  // queue
+  while (job->in_use && !job->finished) {
+    if (!wait_for_exit())
+      return 127;
+  }
+
+  if (!job->in_use)
+    return 127;
+
+  return finish_waited_job(job);
+}
+
+// Wait for the next background job to finish
+static int wait_for_next_job() {
+  Job* job;
+
+  start_pending_jobs();
+
+  while ((job = find_finished_job()) == NULL) {
+    if (!have_background_work() || !wait_for_exit())
+      return 127;
   }
+
+  return finish_waited_job(job);
 }
 
+// Waits for background jobs to finish
+void run_wait(WaitCommand cmd) {
+  int status = 0;
+
+  if (cmd.args[0] == NULL) {
+    // Every job, including the queued ones
+    start_pending_jobs();
+
+    while (have_background_work()) {
+      if (!wait_for_exit())
+        break;
+    }
+
+    check_jobs_bg_status();
+  }
+  else if (strcmp(cmd.args[0], "-n") == 0 && cmd.args[1] == NULL) {
+    status = wait_for_next_job();
+  }
+  else {
+    for (char** arg = cmd.args; *arg != NULL; ++arg) {
+      if ((*arg)[0] != '%') {
+        fprintf(stderr, "wait: invalid argument %s. Use %%N to name a job\n", *arg);
+        status = 2;
+        break;
+      }
+
+      status = wait_for_job_id(*arg);
+    }
+  }
+
+  builtin_status = status;
+}
 
 // Prints the current working directory to stdout
 void run_pwd() {
-  char* cwd = get_current_directory(NULL);
-	printf("%s \n", cwd);
+	printf("%s \n", get_logical_directory());
   // Flush the buffer before returning
   fflush(stdout);
-  free(cwd);
 }
 
-// Prints all background jobs currently in the job list to stdout
-void run_jobs() {
-  for(Node* job_node = job_list.back; job_node != NULL; job_node = job_node->next_node){
-    print_job(((Job*)peek(job_node))->job_id, *(pid_t*)peek_back(&((Job*)peek(job_node))->pid_list), ((Job*)peek(job_node))->cmd_input);
+// Prints the details of a job shown by `jobs -l`
+static void print_job_details(const Job* job) {
+  if (job->pipe_size > 0)
+    printf("\tpipe size: %d\n", job->pipe_size);
+  else
+    printf("\tpipe size: -\n");
+
+  if (job->pending)
+    return;
+
+  if (has_priority(&job->priority)) {
+    char desc[64];
+
+    format_priority(&job->priority, desc, sizeof(desc));
+    printf("\tpriority: %s\n", desc);
+  }
+
+  if (job->placement != NULL) {
+    char cpus[256];
+
+    format_cpu_placement(job->placement, cpus, sizeof(cpus));
+    printf("\tcpus: %s\n", cpus);
+  }
+
+  print_job_usage(job);
+
+  // Usage is only known for the stages that have been reaped
+  for (size_t i = 0; i < job->num_procs; ++i) {
+    const Process* proc = &job->procs[i];
+
+    printf("\t  %8d\t", proc->pid);
+
+    if (proc->cpu != -1)
+      printf("cpu %d ", proc->cpu);
+
+    if (proc->running)
+      printf("running\n");
+    else
+      printf("user %.3fs sys %.3fs maxrss %ldK ctxsw %ld/%ld\n",
+             seconds(proc->usage.ru_utime), seconds(proc->usage.ru_stime),
+             proc->usage.ru_maxrss, proc->usage.ru_nvcsw, proc->usage.ru_nivcsw);
+  }
+}
+
+// Parse a count of background jobs. Returns -1 if the string is not a valid
+// count.
+static int parse_job_count(const char* str) {
+  char* end;
+  long count = strtol(str, &end, 10);
+
+  if (end == str || *end != '\0' || count < 0 || count > INT_MAX)
+    return -1;
+
+  return (int) count;
+}
+
+// Get the number of background jobs allowed to run at once set with
+// QUASH_MAX_BG or 0 if there is no limit
+static int max_background_jobs() {
+  const char* str = lookup_env("QUASH_MAX_BG");
+
+  if (str == NULL || *str == '\0')
+    return 0;
+
+  int max = parse_job_count(str);
+
+  return (max < 0) ? 0 : max;
+}
+
+// Set QUASH_MAX_BG for `jobs -j`. Queued jobs the new limit admits start at
+// the next check of the background jobs.
+static bool set_max_background_jobs(const char* str) {
+  if (parse_job_count(str) < 0) {
+    fprintf(stderr, "jobs: invalid job count %s\n", str);
+    return false;
+  }
+
+  write_env("QUASH_MAX_BG", str);
+
+  return true;
+}
+
+// Check if another background job may start now
+static bool can_start_background_job() {
+  int max = max_background_jobs();
+
+  return max == 0 || num_running_jobs() < max;
+}
+
+// Prints all background jobs currently in the job table to stdout
+void run_jobs(JobsCommand cmd) {
+  bool long_format = false;
+  bool list = true;
+
+  for (char** arg = cmd.args; *arg != NULL; ++arg) {
+    if (strcmp(*arg, "-l") == 0) {
+      long_format = true;
+    }
+    else if (strcmp(*arg, "-j") == 0) {
+      if (arg[1] == NULL || !set_max_background_jobs(arg[1])) {
+        builtin_status = 2;
+        return;
+      }
+
+      ++arg;
+      list = long_format;
+    }
+    else {
+      fprintf(stderr, "jobs: invalid option %s\n", *arg);
+      builtin_status = 2;
+      return;
+    }
+  }
+
+  if (!list)
+    return;
+
+  for(Job* job = next_background_job(NULL); job != NULL; job = next_background_job(job)){
+    if (job->killed)
+      continue;
+
+    if (job->pending)
+      print_pending_job(job);
+    else
+      print_job(job->job_id, job->pgid, job->cmd_input);
+
+    if (long_format)
+      print_job_details(job);
+  }
+  fflush(stdout);
+}
+
+// Writes the captured output of a background job to stdout
+void run_joblog(JobLogCommand cmd) {
+  char* end = NULL;
+  long job_id = (cmd.args[0] != NULL && cmd.args[0][0] == '%') ? strtol(cmd.args[0] + 1, &end, 10) : 0;
+
+  if (end == NULL || *end != '\0' || end == cmd.args[0] + 1 || cmd.args[1] != NULL) {
+    fprintf(stderr, "usage: joblog %%N\n");
+    builtin_status = 2;
+    return;
+  }
+
+  const Job* job = get_job_log(job_id);
+
+  if (job == NULL) {
+    fprintf(stderr, "joblog: %s: no output captured\n", cmd.args[0]);
+    builtin_status = 1;
+    return;
+  }
+
+  if (job->log_dropped > 0)
+    fprintf(stderr, "joblog: %s: the first %zu bytes were dropped\n", cmd.args[0], job->log_dropped);
+
+  fflush(stdout);
+  write_job_log(job, STDOUT_FILENO);
+}
+
+#define JOBPRIO_USAGE "usage: jobprio [-n NICE] [-s other|batch|idle] [-i none|idle|be|rt[:LEVEL]] %N\n"
+
+// Shows or changes the priority of a background job
+void run_jobprio(JobPrioCommand cmd) {
+  JobPriority prio;
+  char** arg = cmd.args;
+
+  clear_priority(&prio);
+
+  for (; *arg != NULL && (*arg)[0] == '-'; arg += 2) {
+    char opt = (*arg)[1];
+
+    if ((opt != 'n' && opt != 's' && opt != 'i') || (*arg)[2] != '\0' || arg[1] == NULL) {
+      fputs(JOBPRIO_USAGE, stderr);
+      builtin_status = 2;
+      return;
+    }
+
+    if (!set_priority_field(&prio, opt, arg[1])) {
+      fprintf(stderr, "jobprio: invalid value %s for -%c\n", arg[1], opt);
+      builtin_status = 1;
+      return;
+    }
+  }
+
+  char* end = NULL;
+  long job_id = (arg[0] != NULL && arg[0][0] == '%') ? strtol(arg[0] + 1, &end, 10) : 0;
+
+  if (end == NULL || *end != '\0' || end == arg[0] + 1 || arg[1] != NULL) {
+    fputs(JOBPRIO_USAGE, stderr);
+    builtin_status = 2;
+    return;
+  }
+
+  Job* job = get_job(job_id);
+
+  if (job == NULL || job_id == FOREGROUND_JOB_ID || job->killed) {
+    fprintf(stderr, "jobprio: %s: no such job\n", arg[0]);
+    builtin_status = 1;
+    return;
+  }
+
+  if (!has_priority(&prio)) {
+    char desc[64];
+
+    format_priority(&job->priority, desc, sizeof(desc));
+    printf("[%d]\t%s\n", job->job_id, desc);
+    fflush(stdout);
+    return;
+  }
+
+  // Later options override the ones the job started with
+  if (prio.nice == PRIORITY_UNSET)
+    prio.nice = job->priority.nice;
+
+  if (prio.policy == PRIORITY_UNSET)
+    prio.policy = job->priority.policy;
+
+  if (prio.ioclass == PRIORITY_UNSET) {
+    prio.ioclass = job->priority.ioclass;
+    prio.iolevel = job->priority.iolevel;
+  }
+
+  job->priority = prio;
+
+  // A queued job picks up the new priority when it is launched
+  for (size_t i = 0; i < job->num_procs; ++i) {
+    if (job->procs[i].running)
+      apply_priority(&job->priority, job->procs[i].pid);
+  }
+}
+
+// Inspects and manages the command path cache
+void run_hash(HashCommand cmd) {
+  char** args = cmd.args;
+
+  if (args[0] == NULL) {
+    print_path_cache();
   }
+  else if (strcmp(args[0], "-r") == 0) {
+    clear_path_cache();
+  }
+  else if (strcmp(args[0], "-d") == 0) {
+    for (char** name = args + 1; *name != NULL; ++name) {
+      if (!forget_cached_path(*name)) {
+        fprintf(stderr, "hash: %s: not found\n", *name);
+        builtin_status = 1;
+      }
+    }
+  }
+  else if (strcmp(args[0], "-p") == 0) {
+    if (args[1] == NULL || args[2] == NULL) {
+      fprintf(stderr, "hash: usage: hash -p path name\n");
+      builtin_status = 2;
+    }
+    else
+      set_cached_path(args[2], args[1]);
+  }
+  else if (strcmp(args[0], "-t") == 0) {
+    for (char** name = args + 1; *name != NULL; ++name) {
+      const char* path = get_cached_path(*name);
+
+      if (path != NULL) {
+        printf("%s\n", path);
+      }
+      else {
+        fprintf(stderr, "hash: %s: not found\n", *name);
+        builtin_status = 1;
+      }
+    }
+  }
+  else {
+    for (char** name = args; *name != NULL; ++name) {
+      if (!hash_command(*name)) {
+        fprintf(stderr, "hash: %s: not found\n", *name);
+        builtin_status = 1;
+      }
+    }
+  }
+
   fflush(stdout);
 }
 
@@ -282,12 +847,26 @@ void child_run_command(Command cmd) {
     run_pwd();
     break;
   case JOBS:
-    run_jobs();
+    run_jobs(cmd.jobs);
+    break;
+  case HASH:
+    run_hash(cmd.hash);
+    break;
+  case JOBLOG:
+    run_joblog(cmd.joblog);
+    break;
+  case JOBPRIO:
+    run_jobprio(cmd.jobprio);
     break;
   case EXPORT:
   case CD:
   case KILL:
   case EXIT:
+  case ASSIGN:
+  case WAIT:
+  case TIMEOUT:
+  case AFTER:
+  case PARALLEL:
   case EOC:
     break;
 
@@ -320,11 +899,21 @@ void parent_run_command(Command cmd) {
   case KILL:
     run_kill(cmd.kill);
     break;
+  case WAIT:
+    run_wait(cmd.wait);
+    break;
   case GENERIC:
   case ECHO:
   case PWD:
   case JOBS:
+  case HASH:
   case EXIT:
+  case ASSIGN:
+  case TIMEOUT:
+  case AFTER:
+  case PARALLEL:
+  case JOBLOG:
+  case JOBPRIO:
   case EOC:
     break;
   default:
@@ -332,162 +921,1368 @@ void parent_run_command(Command cmd) {
   }
 }
 
-void printList(List *l){
-    for(Node* n = l->back;; n = n->next_node){
-        printf("%d ;", *(int*)n->data);
-        //printf("{%p , %p}\n", n->prev_node, n->next_node);
-        if(n == l->front) break;
-    }
-    printf("\n");
+// Check if a stage belongs to a foreground job that gets the terminal
+static bool takes_terminal(CommandHolder holder) {
+  return is_tty() && !(holder.flags & BACKGROUND);
 }
+
 /**
- * @brief Creates one new process centered around the @a Command in the @a
- * CommandHolder setting up redirects and pipes where needed
+ * @brief Launch a @a GenericCommand with posix_spawn(3)
  *
- * @note Processes are not the same as jobs. A single job can have multiple
- * processes running under it. This function creates a process that is part of a
- * larger job->
+ * The descriptor setup that the forked child would do is described up front as
+ * posix_spawn file actions. The C library creates the process with vfork
+ * semantics, so the launch cost does not grow with the memory footprint of
+ * quash.
  *
- * @note Not all commands should be run in the child process. A few need to
- * change the quash process in some way
+ * @param holder The CommandHolder holding the generic command to launch
  *
- * @param holder The CommandHolder to try to run
+ * @param fds The descriptors the process should use for standard in and out
  *
- * @sa Command CommandHolder
+ * @param pgid The process group to join or 0 to lead a new one
+ *
+ * @return The pid of the new process or -1 if it could not be launched
  */
-void create_process(CommandHolder holder, Job* job) { //Multi-pipelining was accomplished using Waqar's algorithm.
-  // Read the flags field from the parser
-  bool p_in  = holder.flags & PIPE_IN;
-  bool p_out = holder.flags & PIPE_OUT;
-  bool r_in  = holder.flags & REDIRECT_IN;
-  bool r_out = holder.flags & REDIRECT_OUT;
-  bool r_app = holder.flags & REDIRECT_APPEND; // This can only be true if r_out
-                                               // is true
-
-  //printf("Proc: %d , Pipes: p_in %d, p_out %d\n", getpid(), p_in, p_out);
-
-  if(p_out){
-    pipe(job->job_pipe[job->next_pipe]);
-  }
-
-	pid_t *m_pid = malloc(sizeof(pid_t));
-	*m_pid = fork();
-
-	if(*m_pid == 0){
-    //printf("child pid %d now executing %s.\n", getpid(), holder.cmd.generic.args[0]);
-    /*
-    if(p_in && p_out){  //we're in the middle of the pipe-line
-    printf("middle pid %d from parent pid %d Pipes: p_in %d, p_out %d\n", getpid(), getppid(), p_in, p_out);
-        dup2(job->job_pipe[P_READ], STDIN_FILENO);
-        dup2(job->job_pipe[P_WRITE], STDOUT_FILENO);
-    } */  
-    if(p_out) { //the writer child to the pipe
-      #if 0
-      printf("writer pid %d from parent %d: Pipes: p_in %d, p_out %d\n", getpid(), getppid(), p_in, p_out);
-      if(close(job->job_pipe[P_READ]) < 0){ 
-        fprintf(stderr, "Child Process %d Error: Failure in closing the Write-end of job_pipe. Error no. %d\n", getpid(), errno); 
-        return;
+static pid_t spawn_generic(CommandHolder holder, StageFds fds, pid_t pgid) {
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setpgroup(&attr, pgid);
+
+  // Quash ignores SIGTTOU, the new program should not
+  sigset_t sigdefault;
+  sigemptyset(&sigdefault);
+  sigaddset(&sigdefault, SIGTTOU);
+  posix_spawnattr_setsigdefault(&attr, &sigdefault);
+  short flags = POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF;
+
+  posix_spawnattr_setflags(&attr, flags);
+
+  // The child hands itself the terminal so it can never read it too early
+  if (takes_terminal(holder))
+    posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+
+  if (fds.in != -1)
+    posix_spawn_file_actions_adddup2(&actions, fds.in, STDIN_FILENO);
+
+  if (fds.out != -1)
+    posix_spawn_file_actions_adddup2(&actions, fds.out, STDOUT_FILENO);
+
+  if (fds.err != -1)
+    posix_spawn_file_actions_adddup2(&actions, fds.err, STDERR_FILENO);
+
+  // Anything quash inherited without close-on-exec must not leak either
+  posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+
+  pid_t pid;
+  char** args = holder.cmd.generic.args;
+  const char* path = resolve_command_path(args[0]);
+  int err = ENOENT;
+
+  if (path != NULL) {
+    err = posix_spawn(&pid, path, &actions, &attr, args, get_envp());
+
+    // The program may have moved since its path was cached
+    if (err == ENOENT && (path = rehash_command_path(args[0])) != NULL)
+      err = posix_spawn(&pid, path, &actions, &attr, args, get_envp());
+  }
+
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+
+  if (err != 0) {
+    fprintf(stderr, "ERROR: Failed to execute %s. Error #%d\n", args[0], err);
+    return -1;
+  }
+
+  return pid;
+}
+
+/**
+ * @brief Check if a command only does work in the quash process
+ *
+ * The child process forked for these commands would have nothing to do, so
+ * they are run directly in quash without creating a process at all.
+ *
+ * @param type The type of the command
+ *
+ * @return True if the command never needs a child process
+ */
+static bool is_parent_only(CommandType type) {
+  return type == CD || type == EXPORT || type == KILL || type == EXIT || type == WAIT;
+}
+
+/**
+ * @brief Run a parent only command inside quash in place of a process
+ *
+ * The command never touches the descriptors planned for it. Once they are
+ * closed the neighbouring stages see end of file or a broken pipe instead of
+ * hanging, and an output redirect has already created or truncated its file.
+ *
+ * @param holder The CommandHolder holding the parent only command
+ *
+ * @param job The job the command is a stage of
+ */
+static void run_in_parent(CommandHolder holder, Job* job) {
+  builtin_status = 0;
+  parent_run_command(holder.cmd);
+
+  // The last stage decides the status of the job
+  if (!(holder.flags & PIPE_OUT))
+    job->exit_status = builtin_status;
+}
+
+/**
+ * @brief Check if a builtin can run inside quash when it makes up the whole job
+ *
+ * @param type The type of the command
+ *
+ * @return True if the builtin only needs its standard streams redirected
+ */
+static bool is_in_process_builtin(CommandType type) {
+  return type == ECHO || type == PWD || type == JOBS || type == HASH || type == JOBLOG ||
+    type == JOBPRIO;
+}
+
+// Point a standard stream at a planned descriptor. The original descriptor is
+// saved so it can be restored later.
+static int swap_std_stream(int std_fd, int fd) {
+  if (fd == -1)
+    return -1;
+
+  int saved = fcntl(std_fd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+  dup2(fd, std_fd);
+
+  return saved;
+}
+
+// Put a standard stream back the way it was before swap_std_stream()
+static void restore_std_stream(int std_fd, int saved) {
+  if (saved != -1) {
+    dup2(saved, std_fd);
+    close(saved);
+  }
+}
+
+/**
+ * @brief Run a builtin that is the only stage of a foreground job inside quash
+ *
+ * Standard in and out are temporarily pointed at the planned descriptors, if
+ * there are any, and restored once the builtin returns. No process is created.
+ *
+ * @param holder The CommandHolder holding the builtin
+ *
+ * @param fds The descriptors planned for the builtin
+ *
+ * @return The exit status of the builtin, or 1 if its redirects could not be
+ * opened
+ */
+static int run_builtin_in_process(CommandHolder holder, StageFds fds) {
+  // build_fd_plan() already reported what failed
+  if (!fds.ok)
+    return 1;
+
+  builtin_status = 0;
+
+  int saved_in = swap_std_stream(STDIN_FILENO, fds.in);
+  int saved_out = swap_std_stream(STDOUT_FILENO, fds.out);
+
+  child_run_command(holder.cmd);
+
+  fflush(stdout);
+
+  restore_std_stream(STDOUT_FILENO, saved_out);
+  restore_std_stream(STDIN_FILENO, saved_in);
+
+  return builtin_status;
+}
+
+// Close the descriptors planned for a stage
+static void close_stage_fds(StageFds* fds) {
+  if (fds->in != -1)
+    close(fds->in);
+
+  if (fds->out != -1)
+    close(fds->out);
+
+  if (fds->err != -1)
+    close(fds->err);
+
+  fds->in = fds->out = fds->err = -1;
+}
+
+// Open the redirect file of a stage, replacing the descriptor in *fd
+static void open_redirect(const char* path, int oflags, int* fd, bool* ok) {
+  int new_fd = open(path, oflags | O_CLOEXEC, 0666);
+
+  if (new_fd == -1) {
+    fprintf(stderr, "ERROR: Failed to open %s. Error #%d\n", path, errno);
+    *ok = false;
+    return;
+  }
+
+  if (*fd != -1)
+    close(*fd);
+
+  *fd = new_fd;
+}
+
+// Parse a byte count with an optional K, M or G suffix. Returns 0 if the
+// string is not a valid size.
+static long parse_size(const char* str) {
+  char* end;
+  long size = strtol(str, &end, 10);
+  int shift = 0;
+
+  if (end == str)
+    return 0;
+
+  switch (*end) {
+  case 'k': case 'K': shift = 10; ++end; break;
+  case 'm': case 'M': shift = 20; ++end; break;
+  case 'g': case 'G': shift = 30; ++end; break;
+  default: break;
+  }
+
+  // The range is checked before shifting, which could overflow otherwise
+  if (*end != '\0' || size <= 0 || size > (INT_MAX >> shift))
+    return 0;
+
+  return size << shift;
+}
+
+// Get the pipe capacity requested with QUASH_PIPE_SIZE or 0 for the system
+// default
+static int requested_pipe_size() {
+  const char* str = lookup_env("QUASH_PIPE_SIZE");
+
+  if (str == NULL || *str == '\0')
+    return 0;
+
+  long size = parse_size(str);
+
+  if (size == 0)
+    fprintf(stderr, "ERROR: Invalid QUASH_PIPE_SIZE %s\n", str);
+
+  return (int) size;
+}
+
+/**
+ * @brief Open every descriptor a pipeline needs before any of it is launched
+ *
+ * All pipes are created with pipe2(2) and all redirect files are opened with
+ * close-on-exec set. Each stage only ever holds its own two descriptors, so no
+ * child can keep a pipe open that it does not use and end of file reaches the
+ * next stage as soon as the writer exits.
+ *
+ * @param holders The stages of the pipeline
+ *
+ * @param[out] plan One entry per stage
+ *
+ * @param num_stages Number of stages in the pipeline
+ *
+ * @return The capacity of the pipes in bytes or 0 if no pipe was created
+ */
+static int build_fd_plan(const CommandHolder* holders, StageFds* plan, size_t num_stages) {
+  int requested = (num_stages > 1) ? requested_pipe_size() : 0;
+  int pipe_size = 0;
+
+  for (size_t i = 0; i < num_stages; ++i)
+    plan[i] = (StageFds) { -1, -1, -1, true };
+
+  for (size_t i = 0; i < num_stages; ++i) {
+    char flags = holders[i].flags;
+
+    if ((flags & PIPE_OUT) && i + 1 < num_stages) {
+      int p[2];
+
+      if (pipe2(p, O_CLOEXEC) == -1) {
+        fprintf(stderr, "ERROR: Failed to create a pipe. Error #%d\n", errno);
+        plan[i].ok = plan[i + 1].ok = false;
+      }
+      else {
+        plan[i].out = p[P_WRITE];
+        plan[i + 1].in = p[P_READ];
+
+        if (requested > 0 && fcntl(p[P_WRITE], F_SETPIPE_SZ, requested) == -1 && pipe_size == 0)
+          fprintf(stderr, "ERROR: Failed to set pipe size to %d. Error #%d\n", requested, errno);
+
+        pipe_size = fcntl(p[P_WRITE], F_GETPIPE_SZ);
+      }
+    }
+
+    // Redirects take precedence over pipes
+    if (flags & REDIRECT_IN)
+      open_redirect(holders[i].redirect_in, O_RDONLY, &plan[i].in, &plan[i].ok);
+
+    if (flags & REDIRECT_OUT) {
+      int oflags = O_WRONLY | O_CREAT | ((flags & REDIRECT_APPEND) ? O_APPEND : O_TRUNC);
+      open_redirect(holders[i].redirect_out, oflags, &plan[i].out, &plan[i].ok);
+    }
+  }
+
+  return pipe_size;
+}
+
+// Get the most bytes of output kept for each background job, set with
+// QUASH_CAPTURE, or 0 if their output is not captured
+static size_t capture_limit() {
+  const char* str = lookup_env("QUASH_CAPTURE");
+
+  if (str == NULL || *str == '\0' || strcmp(str, "0") == 0)
+    return 0;
+
+  long limit = parse_size(str);
+
+  if (limit == 0)
+    fprintf(stderr, "ERROR: Invalid QUASH_CAPTURE %s\n", str);
+
+  return limit;
+}
+
+// Send standard error of every stage, and standard out of the last one unless
+// it is redirected, to a new pipe. Returns its non-blocking read end or -1.
+static int plan_output_capture(StageFds* plan, size_t num_stages) {
+  int p[2];
+
+  if (pipe2(p, O_CLOEXEC) == -1) {
+    fprintf(stderr, "ERROR: Failed to create a pipe. Error #%d\n", errno);
+    return -1;
+  }
+
+  fcntl(p[P_READ], F_SETFL, O_NONBLOCK);
+
+  for (size_t i = 0; i < num_stages; ++i)
+    plan[i].err = fcntl(p[P_WRITE], F_DUPFD_CLOEXEC, 0);
+
+  if (plan[num_stages - 1].out == -1)
+    plan[num_stages - 1].out = fcntl(p[P_WRITE], F_DUPFD_CLOEXEC, 0);
+
+  close(p[P_WRITE]);
+
+  return p[P_READ];
+}
+
+/**
+ * @brief Creates one new process centered around the @a Command in the @a
+ * CommandHolder setting up redirects and pipes where needed
+ *
+ * @note Processes are not the same as jobs. A single job can have multiple
+ * processes running under it. This function creates a process that is part of a
+ * larger job->
+ *
+ * @note Not all commands should be run in the child process. A few need to
+ * change the quash process in some way
+ *
+ * @param holder The CommandHolder to try to run
+ *
+ * @param job The job the process belongs to
+ *
+ * @param fds The descriptors planned for this stage by build_fd_plan(). They
+ * are closed in quash once the stage has been launched.
+ *
+ * @sa Command CommandHolder
+ */
+void create_process(CommandHolder holder, Job* job, StageFds fds) {
+  CommandType type = get_command_holder_type(holder);
+
+  if (!fds.ok) {
+    close_stage_fds(&fds);
+
+    if (!(holder.flags & PIPE_OUT))
+      job->exit_status = 1;
+
+    return;
+  }
+
+  if (is_parent_only(type)) {
+    close_stage_fds(&fds);
+    run_in_parent(holder, job);
+    return;
+  }
+
+  pid_t pid;
+  int cpu = (job->placement != NULL) ? next_stage_cpu(job->placement) : -1;
+
+  // posix_spawn can't set the nice value, the I/O class or the batch and idle
+  // policies, and setting them from quash afterwards would miss anything the
+  // program starts right away. Jobs with a priority are forked instead.
+  bool spawned = use_posix_spawn() && type == GENERIC && !has_priority(&job->priority);
+
+  if (spawned) {
+    // The spawned process inherits the affinity quash has at that moment
+    if (job->placement != NULL) {
+      save_affinity();
+      set_stage_affinity(job->placement, cpu);
+    }
+
+    pid = spawn_generic(holder, fds, job->pgid);
+
+    if (job->placement != NULL)
+      restore_affinity();
+  }
+  else {
+    // Resolve the command here so the result is cached in quash rather than in
+    // the child
+    if (type == GENERIC)
+      resolve_command_path(holder.cmd.generic.args[0]);
+
+    pid = fork();
+
+    if (pid == 0) {
+      // Join the job's process group before doing anything else
+      setpgid(0, job->pgid);
+
+      if (takes_terminal(holder))
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+
+      signal(SIGTTOU, SIG_DFL);
+
+      if (has_priority(&job->priority))
+        apply_priority(&job->priority, 0);
+
+      if (job->placement != NULL && !set_stage_affinity(job->placement, cpu))
+        fprintf(stderr, "ERROR: Failed to set the CPU affinity. Error #%d\n", errno);
+
+      if (fds.in != -1)
+        dup2(fds.in, STDIN_FILENO);
+
+      if (fds.out != -1)
+        dup2(fds.out, STDOUT_FILENO);
+
+      if (fds.err != -1)
+        dup2(fds.err, STDERR_FILENO);
+
+      // Drop every descriptor beyond the standard streams in one call
+      close_range(STDERR_FILENO + 1, CLOSE_RANGE_MAX, 0);
+
+      builtin_status = 0;
+      child_run_command(holder.cmd); // This should be done in the child branch of a fork;
+      exit(builtin_status);
+    }
+  }
+
+  close_stage_fds(&fds);
+
+  if (pid == -1) {
+    if (!spawned)
+      fprintf(stderr, "ERROR: Failed to create a process. Error #%d\n", errno);
+
+    // Like other shells, a command that can't be run exits with 127
+    if (!(holder.flags & PIPE_OUT))
+      job->exit_status = 127;
+  }
+  else {
+    // Set the group from quash as well so it is in place whichever process
+    // runs first
+    if (!spawned)
+      setpgid(pid, job->pgid);
+
+    if (job->pgid == 0)
+      job->pgid = pid;
+
+    add_job_process(job, pid);
+    job->procs[job->num_procs - 1].cpu = cpu;
+
+    if (!(holder.flags & PIPE_OUT))
+      job->status_proc = job->num_procs - 1;
+  }
+}
+
+/***************************************************************************
+ * Functions for the parallel builtin
+ ***************************************************************************/
+
+// Exit status of parallel when it could not run at all. Otherwise its status
+// is the number of tasks that failed, up to PARALLEL_MAX_FAILED.
+#define PARALLEL_ERROR_STATUS 255
+#define PARALLEL_MAX_FAILED 101
+
+#define PARALLEL_READ_SIZE 4096
+
+/**
+ * @brief How a parallel stage was asked to run
+ */
+typedef struct ParallelOptions {
+  size_t max_tasks; /**< Number of tasks allowed to run at once */
+  bool keep_order;  /**< Write the output of the tasks in input order (-k) */
+  char** tmpl;      /**< First word of the command template */
+  size_t tmpl_len;  /**< Number of words in the template */
+  char** inputs;    /**< NULL terminated inputs given after ":::" or NULL to
+                     * read them from standard in */
+} ParallelOptions;
+
+/**
+ * @brief A task of a parallel stage that is running or whose output has not
+ * been written yet
+ */
+typedef struct ParallelTask {
+  size_t proc;  /**< Index of the task's process in the job */
+  bool running; /**< The process has not been reaped yet */
+  int out;      /**< Read end of the task's output pipe with -k, or -1 */
+  char* buf;    /**< Output held back until the earlier tasks are written */
+  size_t len;   /**< Number of bytes in @a buf */
+  size_t cap;   /**< Capacity of @a buf */
+} ParallelTask;
+
+// The tasks of a parallel stage in the order they were started
+IMPLEMENT_DEQUE_STRUCT(TaskQueue, ParallelTask*);
+IMPLEMENT_DEQUE(TaskQueue, ParallelTask*);
+
+// Parse `parallel [-j N] [-k] COMMAND [ARG]... [::: INPUT...]`
+static bool parse_parallel_args(char** args, ParallelOptions* opts) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  opts->max_tasks = (cpus > 0) ? cpus : 1;
+  opts->keep_order = false;
+  opts->inputs = NULL;
+
+  for (; *args != NULL && (*args)[0] == '-'; ++args) {
+    if (strcmp(*args, "--") == 0) {
+      ++args;
+      break;
+    }
+    else if (strcmp(*args, "-k") == 0) {
+      opts->keep_order = true;
+    }
+    else if (strncmp(*args, "-j", 2) == 0) {
+      const char* count = ((*args)[2] != '\0') ? *args + 2 : *++args;
+      int max = (count != NULL) ? parse_job_count(count) : -1;
+
+      if (max <= 0) {
+        fprintf(stderr, "parallel: invalid job count %s\n", (count != NULL) ? count : "");
+        return false;
+      }
+
+      opts->max_tasks = max;
+    }
+    else {
+      fprintf(stderr, "parallel: invalid option %s\n", *args);
+      return false;
+    }
+  }
+
+  opts->tmpl = args;
+  opts->tmpl_len = 0;
+
+  while (args[opts->tmpl_len] != NULL && strcmp(args[opts->tmpl_len], ":::") != 0)
+    ++opts->tmpl_len;
+
+  if (args[opts->tmpl_len] != NULL)
+    opts->inputs = args + opts->tmpl_len + 1;
+
+  if (opts->tmpl_len == 0) {
+    fprintf(stderr, "usage: parallel [-j N] [-k] COMMAND [ARG]... [::: INPUT...]\n");
+    return false;
+  }
+
+  return true;
+}
+
+// Copy a word of the template with every {} replaced by the input
+static char* substitute_input(const char* word, const char* input, bool* substituted) {
+  size_t input_len = strlen(input);
+  size_t len = strlen(word);
+  size_t count = 0;
+
+  for (const char* p = strstr(word, "{}"); p != NULL; p = strstr(p + 2, "{}"))
+    ++count;
+
+  char* str = malloc(len + count * input_len + 1);
+  char* dst = str;
+
+  for (const char* src = word; *src != '\0'; ) {
+    if (src[0] == '{' && src[1] == '}') {
+      memcpy(dst, input, input_len);
+      dst += input_len;
+      src += 2;
+    }
+    else {
+      *dst++ = *src++;
+    }
+  }
+
+  *dst = '\0';
+  *substituted = *substituted || count > 0;
+
+  return str;
+}
+
+// Build the arguments of the task for one input. Like GNU parallel, the input
+// is appended when the template has no {}.
+static char** build_task_args(const ParallelOptions* opts, const char* input) {
+  char** args = malloc((opts->tmpl_len + 2) * sizeof(char*));
+  bool substituted = false;
+  size_t n;
+
+  for (n = 0; n < opts->tmpl_len; ++n)
+    args[n] = substitute_input(opts->tmpl[n], input, &substituted);
+
+  if (!substituted)
+    args[n++] = strdup(input);
+
+  args[n] = NULL;
+
+  return args;
+}
+
+// Get the next input or NULL when there are no more. Lines read from standard
+// in are stored in *line.
+static const char* next_parallel_input(const ParallelOptions* opts, size_t* next,
+                                       FILE* in, char** line, size_t* line_cap) {
+  if (opts->inputs != NULL)
+    return opts->inputs[*next] != NULL ? opts->inputs[(*next)++] : NULL;
+
+  ssize_t len = getline(line, line_cap, in);
+
+  if (len == -1)
+    return NULL;
+
+  if (len > 0 && (*line)[len - 1] == '\n')
+    (*line)[len - 1] = '\0';
+
+  return *line;
+}
+
+// Launch the process of one task through the job's usual machinery
+static ParallelTask* launch_parallel_task(const ParallelOptions* opts, const char* input,
+                                          Job* job, StageFds fds) {
+  ParallelTask* task = calloc(1, sizeof(ParallelTask));
+  int out[2];
+
+  task->out = -1;
+
+  // Every task has its own pipe so its output can wait for its turn
+  if (opts->keep_order && fds.ok) {
+    if (pipe2(out, O_CLOEXEC) == -1) {
+      fprintf(stderr, "ERROR: Failed to create a pipe. Error #%d\n", errno);
+      close_stage_fds(&fds);
+      fds.ok = false;
+    }
+    else {
+      if (fds.out != -1)
+        close(fds.out);
+
+      fds.out = out[P_WRITE];
+      task->out = out[P_READ];
+    }
+  }
+
+  // The group of the job is gone once all of its processes have been reaped
+  if (job->num_running == 0)
+    job->pgid = 0;
+
+  char** args = build_task_args(opts, input);
+  size_t num_procs = job->num_procs;
+
+  create_process(mk_command_holder(NULL, NULL, 0, mk_generic_command(args)), job, fds);
+
+  for (char** arg = args; *arg != NULL; ++arg)
+    free(*arg);
+
+  free(args);
+
+  task->proc = num_procs;
+  task->running = job->num_procs > num_procs;
+
+  return task;
+}
+
+static void write_all(int fd, const char* buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+
+      fprintf(stderr, "parallel: Failed to write output. Error #%d\n", errno);
+      return;
+    }
+
+    buf += n;
+    len -= n;
+  }
+}
+
+static void free_parallel_task(ParallelTask* task) {
+  if (task->out != -1)
+    close(task->out);
+
+  free(task->buf);
+  free(task);
+}
+
+// Read what a task wrote to its pipe into its buffer
+static void read_task_output(ParallelTask* task) {
+  if (task->cap - task->len < PARALLEL_READ_SIZE) {
+    task->cap = (task->cap == 0) ? PARALLEL_READ_SIZE : task->cap * 2;
+    task->buf = realloc(task->buf, task->cap);
+  }
+
+  ssize_t n = read(task->out, task->buf + task->len, task->cap - task->len);
+
+  if (n > 0) {
+    task->len += n;
+  }
+  else if (n == 0 || errno != EINTR) {
+    close(task->out);
+    task->out = -1;
+  }
+}
+
+// Write out the output of the oldest task as it arrives and drop the tasks
+// that are done. Without -k the tasks write straight to the stage's output, so
+// any task that was reaped is done.
+static void flush_parallel_tasks(TaskQueue* tasks, int dest, bool keep_order) {
+  while (!is_empty_TaskQueue(tasks)) {
+    ParallelTask* task = peek_front_TaskQueue(tasks);
+
+    write_all(dest, task->buf, task->len);
+    task->len = 0;
+
+    if (task->running || task->out != -1)
+      break;
+
+    free_parallel_task(pop_front_TaskQueue(tasks));
+  }
+
+  if (keep_order)
+    return;
+
+  for (size_t n = length_TaskQueue(tasks); n > 0; --n) {
+    ParallelTask* task = pop_front_TaskQueue(tasks);
+
+    if (task->running)
+      push_back_TaskQueue(tasks, task);
+    else
+      free_parallel_task(task);
+  }
+}
+
+// Block until a process exits or a task writes output, then handle it.
+// Returns the number of tasks that stopped running and counts the failed ones.
+static size_t wait_for_parallel_tasks(TaskQueue* tasks, Job* job, size_t* failed) {
+  size_t num_tasks = length_TaskQueue(tasks);
+  struct pollfd* fds = malloc((num_tasks + 1) * sizeof(struct pollfd));
+  ParallelTask** polled = malloc((num_tasks + 1) * sizeof(ParallelTask*));
+  size_t nfds = 0;
+
+  fds[nfds++] = (struct pollfd) { .fd = get_reap_fd(), .events = POLLIN };
+
+  for (size_t n = num_tasks; n > 0; --n) {
+    ParallelTask* task = pop_front_TaskQueue(tasks);
+
+    if (task->out != -1) {
+      polled[nfds] = task;
+      fds[nfds++] = (struct pollfd) { .fd = task->out, .events = POLLIN };
+    }
+
+    push_back_TaskQueue(tasks, task);
+  }
+
+  if (poll(fds, nfds, -1) > 0) {
+    for (size_t i = 1; i < nfds; ++i) {
+      if (fds[i].revents != 0)
+        read_task_output(polled[i]);
+    }
+
+    if (fds[0].revents != 0) {
+      while (reap_exited_processes(0) > 0);
+
+      // Background jobs that finished meanwhile make room for queued ones
+      start_pending_jobs();
+    }
+  }
+
+  free(fds);
+  free(polled);
+
+  size_t stopped = 0;
+
+  for (size_t n = num_tasks; n > 0; --n) {
+    ParallelTask* task = pop_front_TaskQueue(tasks);
+
+    if (task->running && !job->procs[task->proc].running) {
+      int status = job->procs[task->proc].status;
+
+      task->running = false;
+      ++stopped;
+
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        ++*failed;
+    }
+
+    push_back_TaskQueue(tasks, task);
+  }
+
+  return stopped;
+}
+
+// Run the tasks of a parallel stage and return its exit status. The stage's
+// standard in is read from and closed when the inputs come from it.
+static int run_parallel_tasks(const ParallelOptions* opts, Job* job, StageFds* fds) {
+  FILE* in = NULL;
+
+  if (opts->inputs == NULL) {
+    in = fdopen(fds->in, "r");
+    fds->in = -1;
+  }
+
+  // The tasks write to the same place as quash
+  fflush(stdout);
+
+  int dest = (fds->out != -1) ? fds->out : STDOUT_FILENO;
+  TaskQueue tasks = new_TaskQueue(opts->max_tasks);
+  size_t next = 0;
+  size_t running = 0;
+  size_t failed = 0;
+  char* line = NULL;
+  size_t line_cap = 0;
+  bool more = true;
+
+  for (;;) {
+    while (more && running < opts->max_tasks) {
+      const char* input = next_parallel_input(opts, &next, in, &line, &line_cap);
+
+      if (input == NULL) {
+        more = false;
+        break;
       }
-      dup2(job->job_pipe[P_WRITE], STDOUT_FILENO);
-      //printf("child pid %d has dup2d.\n", getpid());
-      #endif
-      dup2 (job->job_pipe[job->next_pipe][P_WRITE], STDOUT_FILENO);
-
-        /* We are never going to read from our own pipe so we can safely close it */
-      close (job->job_pipe[job->next_pipe][P_READ]);
-    } //find test-cases -type f -name '*'.txt | grep valgrind
-       
-    if(p_in){ //the reader child from the pipe
-      #if 0
-      printf("reader pid %d from parent pid %d Pipes: p_in %d, p_out %d\n", getpid(), getppid(), p_in, p_out);
-      if(close(job->job_pipe[P_WRITE]) < 0){ 
-        fprintf(stderr, "Child Process %d Error: Failure in closing the Write-end of job_pipe. Error no. %d\n", getpid(), errno); 
-        return;
+
+      // Tasks fed from standard in must not read the rest of the inputs
+      StageFds task_fds = { -1, -1, -1, true };
+
+      if (in != NULL)
+        open_redirect("/dev/null", O_RDONLY, &task_fds.in, &task_fds.ok);
+
+      if (fds->out != -1 && !opts->keep_order)
+        task_fds.out = fcntl(fds->out, F_DUPFD_CLOEXEC, 0);
+
+      ParallelTask* task = launch_parallel_task(opts, input, job, task_fds);
+
+      if (task->running)
+        ++running;
+      else
+        ++failed;
+
+      push_back_TaskQueue(&tasks, task);
+    }
+
+    flush_parallel_tasks(&tasks, dest, opts->keep_order);
+
+    if (!more && is_empty_TaskQueue(&tasks))
+      break;
+
+    running -= wait_for_parallel_tasks(&tasks, job, &failed);
+  }
+
+  destroy_TaskQueue(&tasks);
+  free(line);
+
+  if (in != NULL)
+    fclose(in);
+
+  return (failed < PARALLEL_MAX_FAILED) ? (int) failed : PARALLEL_MAX_FAILED;
+}
+
+/**
+ * @brief Run a parallel stage from quash
+ *
+ * The command template is run once for every input, with at most max_tasks
+ * processes at a time. Every task is a process of the job, launched with
+ * create_process(). This only returns once the last task has exited.
+ *
+ * @param holder The parallel stage
+ *
+ * @param job The job the tasks are added to
+ *
+ * @param fds The descriptors of the stage. The inputs are read from its
+ * standard in unless they are given after ":::" and the tasks write to its
+ * standard out.
+ */
+static void run_parallel(CommandHolder holder, Job* job, StageFds fds) {
+  ParallelOptions opts;
+  int status = PARALLEL_ERROR_STATUS;
+
+  if (fds.ok && parse_parallel_args(holder.cmd.parallel.args, &opts)) {
+    if (opts.inputs == NULL && fds.in == -1)
+      fprintf(stderr, "parallel: no inputs. Give them after ::: or on standard in\n");
+    else
+      status = run_parallel_tasks(&opts, job, &fds);
+  }
+
+  close_stage_fds(&fds);
+
+  // The tasks are not the last stage of the job, parallel is
+  if (!(holder.flags & PIPE_OUT)) {
+    job->status_proc = -1;
+    job->exit_status = status;
+  }
+}
+
+/**
+ * @brief Export the assignments placed in front of a job
+ *
+ * The assignments only last for the launch of the job. Its processes inherit
+ * them and quash's own settings, like QUASH_PIPE_SIZE, see them while the job
+ * is set up.
+ *
+ * @param assigns The ASSIGN holders in front of the job
+ *
+ * @param num_assigns Number of assignments
+ *
+ * @param[out] saved The previous state of the variables to pass to
+ * restore_job_assignments()
+ */
+static void apply_job_assignments(const CommandHolder* assigns, size_t num_assigns, SavedVar* saved) {
+  for (size_t i = 0; i < num_assigns; ++i) {
+    const char* old = lookup_env(assigns[i].cmd.assign.env_var);
+
+    saved[i].val = (old != NULL) ? strdup(old) : NULL;
+    saved[i].exported = is_exported_variable(assigns[i].cmd.assign.env_var);
+    write_env(assigns[i].cmd.assign.env_var, assigns[i].cmd.assign.val);
+  }
+}
+
+// Put back the variables changed by apply_job_assignments() in reverse order
+static void restore_job_assignments(const CommandHolder* assigns, size_t num_assigns, SavedVar* saved) {
+  for (size_t i = num_assigns; i-- > 0; ) {
+    const char* env_var = assigns[i].cmd.assign.env_var;
+
+    if (saved[i].val == NULL) {
+      unset_env(env_var);
+    }
+    else {
+      assign_env(env_var, saved[i].val);
+
+      // A shell variable is only exported for the job it is assigned in front
+      // of
+      if (!saved[i].exported)
+        unexport_variable(env_var);
+    }
+
+    free(saved[i].val);
+  }
+}
+
+// Count the assignments in front of a script
+static size_t count_assignments(const CommandHolder* holders) {
+  size_t num_assigns = 0;
+
+  while (get_command_holder_type(holders[num_assigns]) == ASSIGN)
+    ++num_assigns;
+
+  return num_assigns;
+}
+
+// Count the stages of a pipeline
+static size_t count_stages(const CommandHolder* holders) {
+  size_t num_stages = 0;
+
+  while (get_command_holder_type(holders[num_stages]) != EOC)
+    ++num_stages;
+
+  return num_stages;
+}
+
+/**
+ * @brief Launch every stage of a job
+ *
+ * @param job The job the processes belong to
+ *
+ * @param holders The script of the job, including the assignments in front
+ * of it
+ */
+static void launch_job(Job* job, const CommandHolder* holders) {
+  // Assignments in front of the job only apply while it is launched
+  size_t num_assigns = count_assignments(holders);
+  const CommandHolder* stages = holders + num_assigns;
+  size_t num_stages = count_stages(stages);
+
+  SavedVar saved_vars[num_assigns + 1];
+  apply_job_assignments(holders, num_assigns, saved_vars);
+
+  StageFds plan[num_stages];
+  job->pipe_size = build_fd_plan(stages, plan, num_stages);
+  job->timed = stages[0].flags & TIMED;
+  job->placement = new_cpu_placement(num_stages);
+
+  // Foreground jobs keep the priority of quash
+  if (job->job_id != FOREGROUND_JOB_ID)
+    inherit_background_priority(&job->priority);
+
+  size_t log_limit = (job->job_id != FOREGROUND_JOB_ID) ? capture_limit() : 0;
+  int capture = (log_limit > 0) ? plan_output_capture(plan, num_stages) : -1;
+
+  size_t parallel_stage = num_stages;
+
+  // Run all commands in the `holder` array. This is every process's cmd per job
+  for (size_t i = 0; i < num_stages; ++i) {
+    if (get_command_holder_type(stages[i]) == PARALLEL)
+      parallel_stage = i;
+    else
+      create_process(stages[i], job, plan[i]);
+  }
+
+  // parallel runs in quash until its last task is done, so the stages around
+  // it must be running already
+  if (parallel_stage < num_stages)
+    run_parallel(stages[parallel_stage], job, plan[parallel_stage]);
+
+  if (job->time_limit > 0 && job->pgid != 0)
+    start_job_deadline(job);
+
+  if (capture != -1 && job->num_procs > 0)
+    capture_job_output(job, capture, log_limit);
+  else if (capture != -1)
+    close(capture);
+
+  restore_job_assignments(holders, num_assigns, saved_vars);
+}
+
+// Parse a duration in seconds with an optional s, m, h or d suffix. Returns -1
+// if the string is not a valid duration.
+static double parse_duration(const char* str) {
+  char* end;
+  double seconds = strtod(str, &end);
+
+  switch (*end) {
+  case 's': ++end; break;
+  case 'm': seconds *= 60; ++end; break;
+  case 'h': seconds *= 60 * 60; ++end; break;
+  case 'd': seconds *= 24 * 60 * 60; ++end; break;
+  default: break;
+  }
+
+  if (end == str || *end != '\0' || !(seconds >= 0) || seconds > INT_MAX)
+    return -1;
+
+  return seconds;
+}
+
+// Replace the timeout stages of a job with the commands they wrap. The
+// shortest limit among them applies to the whole job and is stored in
+// *time_limit. Returns false after printing an error if a timeout is invalid.
+static bool unwrap_timeouts(CommandHolder* stages, double* time_limit, double* kill_grace) {
+  for (CommandHolder* stage = stages; get_command_holder_type(*stage) != EOC; ++stage) {
+    if (get_command_holder_type(*stage) != TIMEOUT)
+      continue;
+
+    char** args = stage->cmd.timeout.args;
+
+    if (args[0] != NULL && strcmp(args[0], "-k") == 0) {
+      if (args[1] == NULL || (*kill_grace = parse_duration(args[1])) < 0) {
+        fprintf(stderr, "timeout: invalid kill duration %s\n", (args[1] != NULL) ? args[1] : "");
+        return false;
       }
-      dup2(job->job_pipe[P_READ], STDIN_FILENO);
-      #endif
-      dup2 (job->job_pipe[job->prev_pipe][P_READ], STDIN_FILENO);
 
-        
-        /* We are never going to write to the previous pipe so we can safely close it */
-      close (job->job_pipe[job->prev_pipe][P_WRITE]);
+      args += 2;
     }
 
-    if(r_out == true){
-        if(r_app==true){
-          FILE* out_file;
-          out_file=fopen(holder.redirect_out,"a"); //a indicated append
-          dup2(fileno(out_file),STDOUT_FILENO); //http://stackoverflow.com/questions/14543443/in-c-how-do-you-redirect-stdin-stdout-stderr-to-files-when-making-an-execvp-or-- was throwing a really weird warning because it wasn't cast
-          fclose(out_file);
-        }
-        else{
-          FILE* out_file;
-          out_file=fopen(holder.redirect_out,"w"); //w indicates write
-          dup2(fileno(out_file),STDOUT_FILENO);
-          fclose(out_file);
-        }
+    double limit = (args[0] != NULL) ? parse_duration(args[0]) : -1;
+
+    if (limit < 0 || args[1] == NULL) {
+      fprintf(stderr, "usage: timeout [-k DURATION] DURATION COMMAND [ARG]...\n");
+      return false;
     }
-    
-    if(r_in == true){
-        FILE* in_file;
-        in_file = fopen(holder.redirect_in, "r");
-        dup2(fileno(in_file), STDIN_FILENO);
-        fclose(in_file);
+
+    // The deadline belongs to a job's processes, which builtins don't have
+    stage->cmd = mk_command_from_args(args + 1);
+
+    if (get_command_holder_type(*stage) != GENERIC) {
+      fprintf(stderr, "timeout: %s: not an external command\n", args[1]);
+      return false;
     }
-    
-    child_run_command(holder.cmd); // This should be done in the child branch of a fork;  
-    exit(EXIT_SUCCESS);
-	}
-	else{  
-    #if 0
-    dup2(job_pipe[P_READ], STDIN_FILENO);    
-    if(p_out){
-      //close(job_pipe[P_WRITE]);
-      if(close(job_pipe[P_READ]) < 0)
-      { 
-        fprintf(stderr, "Error: Failure in closing the Write-end of job_pipe. Error no. %d\n", errno); 
-      } 
+
+    // A zero duration disables the limit, like timeout(1)
+    if (limit > 0 && (*time_limit == 0 || limit < *time_limit))
+      *time_limit = limit;
+  }
+
+  return true;
+}
+
+// Create a background job that keeps a copy of its script until it starts
+static Job* new_pending_job(const CommandHolder* holders, double time_limit, double kill_grace) {
+  Job* job = new_background_job(get_command_string());
+
+  job->pending = true;
+  job->time_limit = time_limit;
+  job->kill_grace = kill_grace;
+  job->script = copy_script(holders);
+
+  return job;
+}
+
+static void push_job_id(PendingQueue* queue, int job_id) {
+  if (queue->data == NULL)
+    *queue = new_PendingQueue(16);
+
+  push_back_PendingQueue(queue, job_id);
+}
+
+// Put a background job in the queue until a slot frees up
+static void queue_job(const CommandHolder* holders, double time_limit, double kill_grace) {
+  Job* job = new_pending_job(holders, time_limit, kill_grace);
+
+  push_job_id(&pending_jobs, job->job_id);
+
+  printf("Background job queued: ");
+  print_pending_job(job);
+}
+
+// Hold a background job back until the jobs in after have succeeded. The job
+// takes ownership of the array.
+static void block_job(const CommandHolder* holders, int* after, size_t num_after,
+                      double time_limit, double kill_grace) {
+  Job* job = new_pending_job(holders, time_limit, kill_grace);
+
+  job->after = after;
+  job->num_after = num_after;
+
+  push_job_id(&blocked_jobs, job->job_id);
+
+  printf("Background job blocked: ");
+  print_pending_job(job);
+}
+
+typedef enum DependencyState {
+  DEPENDENCY_RUNNING,
+  DEPENDENCY_SUCCEEDED,
+  DEPENDENCY_FAILED
+} DependencyState;
+
+// Check how a job another job was started after ended. A pending job that was
+// killed or cancelled never runs, so it counts as failed.
+static DependencyState dependency_state(int job_id) {
+  Job* job = get_job(job_id);
+
+  if (job == NULL)
+    return DEPENDENCY_FAILED;
+
+  if (job->pending)
+    return job->killed ? DEPENDENCY_FAILED : DEPENDENCY_RUNNING;
+
+  if (!job->finished)
+    return DEPENDENCY_RUNNING;
+
+  return (job->exit_status == 0) ? DEPENDENCY_SUCCEEDED : DEPENDENCY_FAILED;
+}
+
+// Drop the dependencies of a blocked job that succeeded and tell whether it
+// can start, has to keep waiting or will never run
+static DependencyState update_dependencies(Job* job) {
+  DependencyState state = DEPENDENCY_SUCCEEDED;
+  size_t left = 0;
+
+  if (job->killed)
+    return DEPENDENCY_FAILED;
+
+  for (size_t i = 0; i < job->num_after; ++i) {
+    DependencyState dep = dependency_state(job->after[i]);
+
+    if (dep == DEPENDENCY_FAILED)
+      return DEPENDENCY_FAILED;
+
+    if (dep == DEPENDENCY_RUNNING) {
+      job->after[left++] = job->after[i];
+      state = DEPENDENCY_RUNNING;
     }
-    
-    if(p_in){ //parent must close the end of the pipe
-      if(close(job->job_pipe[P_READ]) < 0)
-      { 
-        fprintf(stderr, "Parent Error: Failure in closing the Write-end of job_pipe. Error no. %d\n", errno); 
-      } 
+  }
+
+  job->num_after = left;
+
+  return state;
+}
+
+// Queue the blocked jobs whose dependencies all succeeded and cancel the ones
+// with a failed dependency. This runs after every reap, before any finished
+// job can be released and its id reused, so the ids in after stay valid.
+static void resolve_blocked_jobs() {
+  PendingQueue cancelled = { NULL, 0, 0, 0, NULL };
+  bool changed = true;
+
+  // Cancelling a job fails the jobs started after it in turn
+  while (changed && blocked_jobs.data != NULL) {
+    changed = false;
 
-      if(close(job->job_pipe[P_WRITE]) < 0)
-      { 
-        fprintf(stderr, "Parent Error: Failure in closing the Read-end of job_pipe. Error no. %d\n", errno); 
-      } 
+    for (size_t n = length_PendingQueue(&blocked_jobs); n > 0; --n) {
+      Job* job = get_job(pop_front_PendingQueue(&blocked_jobs));
+
+      switch (update_dependencies(job)) {
+      case DEPENDENCY_SUCCEEDED:
+        push_job_id(&pending_jobs, job->job_id);
+        break;
+
+      case DEPENDENCY_FAILED:
+        // A killed job was reported when it was killed
+        if (!job->killed) {
+          printf("Cancelled: \t");
+          print_pending_job(job);
+          job->killed = true;
+        }
+
+        // Kept in the table until the jobs after it have seen it
+        push_job_id(&cancelled, job->job_id);
+        changed = true;
+        break;
+
+      case DEPENDENCY_RUNNING:
+        push_back_PendingQueue(&blocked_jobs, job->job_id);
+        break;
+      }
+    }
+  }
+
+  if (cancelled.data != NULL) {
+    while (!is_empty_PendingQueue(&cancelled))
+      release_job(get_job(pop_front_PendingQueue(&cancelled)));
+
+    destroy_PendingQueue(&cancelled);
+  }
+}
+
+// Start queued background jobs while the limit allows it
+static void start_pending_jobs() {
+  resolve_blocked_jobs();
+
+  while (pending_jobs.data != NULL &&
+         !is_empty_PendingQueue(&pending_jobs) &&
+         can_start_background_job()) {
+    Job* job = get_job(pop_front_PendingQueue(&pending_jobs));
+
+    // Killed while it was queued
+    if (job->killed) {
+      release_job(job);
+      continue;
+    }
+
+    job->pending = false;
+    launch_job(job, job->script);
+
+    free_script(job->script);
+    job->script = NULL;
+
+    // Nothing could be launched for this background job
+    if (job->num_procs == 0)
+      release_job(job);
+  }
+}
+
+// Start every queued and blocked background job before quash exits
+void wait_for_pending_jobs() {
+  start_pending_jobs();
+
+  while ((pending_jobs.data != NULL && !is_empty_PendingQueue(&pending_jobs)) ||
+         (blocked_jobs.data != NULL && !is_empty_PendingQueue(&blocked_jobs))) {
+    if (reap_exited_processes(-1) == -1 && errno != EINTR)
+      break;
+
+    start_pending_jobs();
+  }
+
+  destroy_PendingQueue(&pending_jobs);
+  destroy_PendingQueue(&blocked_jobs);
+}
+
+// Parse the job list of an after stage at the front of a job and replace the
+// stage with the command it wraps. The ids are returned in *after, or NULL if
+// the job has no after stage. Returns false after printing an error if the
+// stage is invalid.
+static bool unwrap_after(CommandHolder* stages, int** after, size_t* num_after) {
+  *after = NULL;
+  *num_after = 0;
+
+  for (size_t i = 1; get_command_holder_type(stages[i]) != EOC; ++i) {
+    if (get_command_holder_type(stages[i]) == AFTER) {
+      fprintf(stderr, "after: must start the job\n");
+      return false;
     }
-    #endif
+  }
+
+  if (get_command_holder_type(stages[0]) != AFTER)
+    return true;
 
-    if (p_out){
-      close (job->job_pipe[job->next_pipe][P_WRITE]);
+  char** args = stages[0].cmd.after.args;
+  size_t n = 0;
+
+  while (args[n] != NULL && args[n][0] == '%')
+    ++n;
+
+  char** cmd = (args[n] != NULL && strcmp(args[n], "--") == 0) ? args + n + 1 : args + n;
+
+  if (n == 0 || *cmd == NULL) {
+    fprintf(stderr, "usage: after %%N... [--] COMMAND [ARG]...\n");
+    return false;
+  }
+
+  int* ids = malloc(n * sizeof(int));
+
+  for (size_t i = 0; i < n; ++i) {
+    char* end;
+    long job_id = strtol(args[i] + 1, &end, 10);
+
+    if (*end != '\0' || end == args[i] + 1 || job_id == FOREGROUND_JOB_ID ||
+        get_job(job_id) == NULL) {
+      fprintf(stderr, "after: %s: no such job\n", args[i]);
+      free(ids);
+      return false;
     }
 
-    /* Update the pipe trackers for next iteration */
-    job->next_pipe = (job->next_pipe + 1) % 2;
-    job->prev_pipe = (job->prev_pipe + 1) % 2;
+    ids[i] = job_id;
+  }
+
+  stages[0].cmd = mk_command_from_args(cmd);
+  *after = ids;
+  *num_after = n;
+
+  return true;
+}
+
+// Block until every job in after has succeeded. Returns false if one of them
+// failed.
+static bool wait_for_dependencies(const int* after, size_t num_after) {
+  for (;;) {
+    bool done = true;
+
+    for (size_t i = 0; i < num_after; ++i) {
+      DependencyState state = dependency_state(after[i]);
+
+      if (state == DEPENDENCY_FAILED)
+        return false;
+
+      done = done && state == DEPENDENCY_SUCCEEDED;
+    }
 
-    if(get_command_type(holder.cmd) == CD || get_command_type(holder.cmd) == EXPORT || get_command_type(holder.cmd) == KILL)
-		  parent_run_command(holder.cmd); // This should be done in the parent branch of // a fork   
+    if (done)
+      return true;
 
-    //printf("parent pid: %d generated child pid: %d\n", getpid(), *m_pid)  ;        
-    add_to_front(&job->pid_list, m_pid); 
-    //printList(pid_list);                              
-	}
+    if (!wait_for_exit())
+      return false;
+  }
 }
-//find test-cases -type f -name '*'.txt | grep valgrind
-void init_job(Job* job){
-  job->job_id = 1;
-  init_list(&job->pid_list);
-  job->cmd_input = get_command_string();
-  /*if(pipe(job->job_pipe) < 0){
-    fprintf(stderr, "Piping failed for the command %s. Error no. %d", get_command_string(), errno);
-  }*/
-  job->prev_pipe = -1;
-  job->next_pipe = 0;
+
+// parallel blocks quash while it runs its tasks, so it only runs as part of a
+// foreground job, once per job
+static bool check_parallel_stages(const CommandHolder* stages) {
+  size_t count = 0;
+
+  for (size_t i = 0; get_command_holder_type(stages[i]) != EOC; ++i)
+    count += get_command_holder_type(stages[i]) == PARALLEL;
+
+  if (count > 0 && (stages[0].flags & BACKGROUND)) {
+    fprintf(stderr, "parallel: can't run in the background\n");
+    return false;
+  }
+
+  if (count > 1) {
+    fprintf(stderr, "parallel: only one per job\n");
+    return false;
+  }
+
+  return true;
 }
 
 // Run a list of commands
@@ -495,7 +2290,11 @@ void run_script(CommandHolder* holders) {
   if (holders == NULL)
     return;
 
-  if(!is_empty(&job_list))
+  CommandType first_type = get_command_holder_type(holders[count_assignments(holders)]);
+
+  // wait reports the jobs it waits for itself and after needs to see how the
+  // jobs it names ended, so they must still be there
+  if (first_type != WAIT && first_type != AFTER)
     check_jobs_bg_status();
 
   if (get_command_holder_type(holders[0]) == EXIT &&
@@ -503,47 +2302,127 @@ void run_script(CommandHolder* holders) {
     end_main_loop();
     return;
   }
- 
-  Job* job = malloc(sizeof(Job));
-  init_job(job);
-  
-  CommandType type;
-  // Run all commands in the `holder` array. This is every process's cmd per job'
-  /*
-  if(pipe(job_pipe) < 0){
-    fprintf(stderr, "Piping Failed. ERROR no. %d\n", errno);
+
+  size_t num_assigns = count_assignments(holders);
+  CommandHolder* stages = holders + num_assigns;
+  bool background = stages[0].flags & BACKGROUND;
+
+  // A line of nothing but assignments sets shell variables
+  if (get_command_holder_type(stages[0]) == EOC) {
+    for (size_t i = 0; i < num_assigns; ++i)
+      assign_env(holders[i].cmd.assign.env_var, holders[i].cmd.assign.val);
+
+    last_exit_status = 0;
+    return;
+  }
+  double time_limit = 0;
+  double kill_grace = DEFAULT_KILL_GRACE;
+  int* after;
+  size_t num_after;
+
+  if (!unwrap_after(stages, &after, &num_after)) {
+    last_exit_status = 2;
+    return;
+  }
+
+  if (!unwrap_timeouts(stages, &time_limit, &kill_grace)) {
+    free(after);
+    last_exit_status = TIMEOUT_USAGE_STATUS;
+    return;
+  }
+
+  if (!check_parallel_stages(stages)) {
+    free(after);
+    last_exit_status = PARALLEL_ERROR_STATUS;
+    return;
+  }
+
+  if (num_after > 0 && background) {
+    block_job(holders, after, num_after, time_limit, kill_grace);
+    last_exit_status = 0;
+
+    // Some of the jobs may be done already
+    start_pending_jobs();
+    return;
+  }
+
+  // A foreground job waits for the jobs it runs after right here
+  if (num_after > 0) {
+    bool ok = wait_for_dependencies(after, num_after);
+
+    free(after);
+
+    if (!ok) {
+      fprintf(stderr, "after: a job it depends on failed\n");
+      last_exit_status = 1;
+      return;
+    }
+  }
+
+  // Builtins that make up a whole foreground job don't need a process, unless
+  // the job is timed and needs one to measure
+  if (is_in_process_builtin(get_command_holder_type(stages[0])) &&
+      count_stages(stages) == 1 &&
+      !background &&
+      !(stages[0].flags & TIMED)) {
+    SavedVar saved_vars[num_assigns + 1];
+    apply_job_assignments(holders, num_assigns, saved_vars);
+
+    StageFds fds;
+    build_fd_plan(stages, &fds, 1);
+    last_exit_status = run_builtin_in_process(stages[0], fds);
+    close_stage_fds(&fds);
+
+    restore_job_assignments(holders, num_assigns, saved_vars);
+    return;
+  }
+
+  // Jobs already queued go first
+  if (background &&
+      ((pending_jobs.data != NULL && !is_empty_PendingQueue(&pending_jobs)) ||
+       !can_start_background_job())) {
+    queue_job(holders, time_limit, kill_grace);
+    last_exit_status = 0;
     return;
   }
-*/
 
-  for (int i = 0; (type = get_command_holder_type(holders[i])) != EOC; ++i){
-		create_process(holders[i], job); 
-	} 
-  if (!(holders[0].flags & BACKGROUND)) {
+  Job* job = background ? new_background_job(get_command_string()) : new_foreground_job(get_command_string());
+  job->time_limit = time_limit;
+  job->kill_grace = kill_grace;
+  launch_job(job, holders);
+
+  if (!background) {
     // Not a background Job
     // Wait for all processes under the job to complete
-      int status;
-      for(; !is_empty(&job->pid_list) ;remove_from_back(&job->pid_list, &free)){
-        //printf("List: ");printList(&job->pid_list);
-        //printf("checking proc %d\n", *(pid_t*)peek_back(&job->pid_list));
-        if ((waitpid(*(pid_t*)peek_back(&job->pid_list), &status, 0)) == -1) {
-          fprintf(stderr, "Job %d, Process %d encountered an error. ERROR %d\n", job->job_id, *(pid_t*)peek_back(&job->pid_list), errno);
-          //exit(EXIT_FAILURE);
-        }      //find test-cases -type f -name '*'.txt | grep valgrind 
-        /*else{
-          printf("process %d successfully finished.\n", *child_process);
-        }*/
+      while (job->num_running > 0) {
+        if (reap_exited_processes(-1) == -1 && errno != EINTR) {
+          fprintf(stderr, "Job %d encountered an error. ERROR %d\n", job->job_id, errno);
+          break;
+        }
+
+        // Background jobs that finished meanwhile make room for queued ones
+        start_pending_jobs();
       }
-      remove_job(job);
+
+      // Take the terminal back from the job
+      if (is_tty() && job->pgid != 0)
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+
+      if (job->timed)
+        print_job_times(job);
+
+      last_exit_status = job->exit_status;
+      release_job(job);
+  }
+  else if (job->num_procs == 0) {
+    // Nothing could be launched for this background job, or it only ran
+    // builtins inside quash, so it is already over
+    last_exit_status = job->exit_status;
+    release_job(job);
   }
   else {
-    // A background job->
-    
-    if(!is_empty(&job_list)){
-      job->job_id = ((Job*)peek_front(&job_list))->job_id + 1; //otherwise assign a new job id
-    }
-    add_to_front(&job_list, job); //push to the queue the new job
-    print_job_bg_start(job->job_id, *(pid_t*)peek_back(&job->pid_list), job->cmd_input);
-
+    // A background job
+    last_exit_status = 0;
+    print_job_bg_start(job->job_id, job->pgid, job->cmd_input);
   }
 }
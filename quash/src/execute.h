@@ -21,6 +21,29 @@
  */
 const char* lookup_env(const char* env_var);
 
+/**
+ * @brief Look up a variable whose name is part of a longer string
+ *
+ * @param env_var Start of the name of the variable
+ *
+ * @param len Length of the name
+ *
+ * @return String containing the value of the variable or NULL if it is not
+ * set
+ */
+const char* lookup_n_env(const char* env_var, size_t len);
+
+/**
+ * @brief Set a shell variable without exporting it
+ *
+ * Processes only see the variable if it was exported before.
+ *
+ * @param env_var Variable to set
+ *
+ * @param val String with the value to set the variable env_var to
+ */
+void assign_env(const char* env_var, const char* val);
+
 /**
  * @brief Function to set and define environment variable values
  *
@@ -34,20 +57,55 @@ void write_env(const char* env_var, const char* val);
  * @brief Get the real current working directory
  *
  * This is not necessarily the same as the PWD environment variable and setting
- * PWD does not actually change the current working directory.
+ * PWD does not actually change the current working directory. Quash tracks the
+ * directory across cd, so this makes no system call.
  *
  * @param[out] should_free Set this to true if the returned string should be
- * free'd by the caller and false otherwise.
+ * free'd by the caller and false otherwise. Always set to false.
  *
  * @return A string representing the current working directory
+ *
+ * @sa get_physical_directory()
  */
 char* get_current_directory(bool* should_free);
 
 /**
- * @brief Check on background jobs to see if they have exited
+ * @brief Report and remove the background jobs that have finished
+ *
+ * Exited children are reaped first. The job list is only walked when a job
+ * finished since the last check. When QUASH_ACCOUNTING is set, the wall time
+ * and resource usage of each job are printed under its completion message.
  */
 void check_jobs_bg_status();
 
+/**
+ * @brief Get the exit status of the last foreground job
+ *
+ * @return The exit status, or 128 plus the number of the signal that
+ * terminated the job
+ */
+int get_last_exit_status();
+
+/**
+ * @brief Get a descriptor that becomes readable when a child process exits
+ *
+ * Quash polls it together with standard in so children are reaped while it
+ * waits for input.
+ *
+ * @return A descriptor to poll for reading
+ */
+int get_job_event_fd();
+
+/**
+ * @brief Reap every child process that has exited without blocking
+ *
+ * Each exited child costs one event. Completed jobs are not reported here.
+ *
+ * @return True if a background job finished and has not been reported by
+ * check_jobs_bg_status() yet
+ */
+bool reap_children();
+
 /**
  * @brief Print a job to standard out
  *
@@ -146,9 +204,75 @@ void run_pwd();
 /**
  * @brief Run the builtin jobs command to show the jobs list
  *
- * @sa PWDCommand
+ * With "-l" the details of each job, such as the capacity of its pipes and
+ * the resources used by its reaped processes, are printed under it. "-j N"
+ * sets the number of background jobs that may run at once (QUASH_MAX_BG).
+ * Jobs started beyond it wait in a queue and are listed as "queued". Jobs
+ * started with after that wait for other jobs are listed as "blocked".
+ *
+ * @param cmd A @a JobsCommand
+ *
+ * @sa JobsCommand
+ */
+void run_jobs(JobsCommand cmd);
+
+/**
+ * @brief Run the builtin wait command to block until background jobs finish
+ *
+ * With no arguments every background job, including queued ones, is waited
+ * for. "%N" waits for job N and "-n" for the next job to finish. The jobs
+ * waited for are reported and removed from the job table, and the exit status
+ * of the last one becomes the status of wait.
+ *
+ * @param cmd A @a WaitCommand
+ *
+ * @sa WaitCommand
  */
-void run_jobs();
+void run_wait(WaitCommand cmd);
+
+/**
+ * @brief Run the builtin joblog command to show the captured output of a
+ * background job
+ *
+ * Output is only captured while QUASH_CAPTURE is set to the most bytes kept
+ * for each job, like "64K". "%N" names the job, which may have been reported
+ * already as long as its id has not been reused.
+ *
+ * @param cmd A @a JobLogCommand
+ *
+ * @sa JobLogCommand
+ */
+void run_joblog(JobLogCommand cmd);
+
+/**
+ * @brief Run the builtin jobprio command to show or change the priority of a
+ * background job
+ *
+ * "jobprio [-n NICE] [-s POLICY] [-i CLASS[:LEVEL]] %N" gives every running
+ * process of the job the new nice value, scheduling policy or I/O class. A
+ * queued job starts with them. Without options the priority of the job is
+ * printed.
+ *
+ * @param cmd A @a JobPrioCommand
+ *
+ * @sa JobPrioCommand
+ */
+void run_jobprio(JobPrioCommand cmd);
+
+/**
+ * @brief Run the builtin hash command to inspect and manage the command path
+ * cache
+ *
+ * With no arguments the cached commands are listed. "-r" clears the cache,
+ * "-d name..." forgets names, "-p path name" stores a path for a name without
+ * searching PATH, "-t name..." prints cached paths and any other names are
+ * looked up in PATH and cached.
+ *
+ * @param cmd A @a HashCommand
+ *
+ * @sa HashCommand
+ */
+void run_hash(HashCommand cmd);
 
 /**
  * @brief Common entry point for all commands
@@ -162,4 +286,12 @@ void run_jobs();
  */
 void run_script(CommandHolder* holders);
 
+/**
+ * @brief Start every background job still waiting in the queue
+ *
+ * Called before quash exits so no queued job is lost. Waits for running
+ * background jobs to finish whenever the QUASH_MAX_BG limit is reached.
+ */
+void wait_for_pending_jobs();
+
 #endif
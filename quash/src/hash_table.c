@@ -0,0 +1,186 @@
+/**
+ * @file hash_table.c
+ *
+ * @brief Implements the string keyed hash table
+ */
+
+#include "hash_table.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+// FNV-1a hash of the first len characters of key
+static size_t __hash(const char* key, size_t len) {
+  uint64_t h = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char) key[i];
+    h *= 1099511628211ULL;
+  }
+
+  return (size_t) h;
+}
+
+// Check if an entry's key is exactly the first len characters of key
+static inline bool __key_equals(const HashEntry* e, const char* key, size_t len) {
+  return strncmp(e->key, key, len) == 0 && e->key[len] == '\0';
+}
+
+static void __free_entry(HashEntry* e) {
+  free(e->key);
+  free(e->value);
+  free(e);
+}
+
+// Double the number of buckets and move every entry to its new chain
+static void __grow(HashTable* table) {
+  size_t new_cap = table->cap * 2;
+  HashEntry** buckets = calloc(new_cap, sizeof(HashEntry*));
+
+  if (buckets == NULL)
+    return; // Keep using the longer chains
+
+  for (size_t i = 0; i < table->cap; ++i) {
+    HashEntry* e = table->buckets[i];
+
+    while (e != NULL) {
+      HashEntry* next = e->next;
+      size_t b = __hash(e->key, strlen(e->key)) % new_cap;
+
+      e->next = buckets[b];
+      buckets[b] = e;
+      e = next;
+    }
+  }
+
+  free(table->buckets);
+  table->buckets = buckets;
+  table->cap = new_cap;
+}
+
+void init_hash_table(HashTable* table, size_t init_cap) {
+  assert(table != NULL);
+
+  if (init_cap == 0)
+    init_cap = 1;
+
+  table->buckets = calloc(init_cap, sizeof(HashEntry*));
+  table->cap = init_cap;
+  table->size = 0;
+}
+
+void destroy_hash_table(HashTable* table) {
+  assert(table != NULL);
+
+  if (table->buckets == NULL)
+    return;
+
+  empty_hash_table(table);
+  free(table->buckets);
+
+  table->buckets = NULL;
+  table->cap = 0;
+}
+
+void empty_hash_table(HashTable* table) {
+  assert(table != NULL);
+
+  for (size_t i = 0; i < table->cap; ++i) {
+    HashEntry* e = table->buckets[i];
+
+    while (e != NULL) {
+      HashEntry* next = e->next;
+      __free_entry(e);
+      e = next;
+    }
+
+    table->buckets[i] = NULL;
+  }
+
+  table->size = 0;
+}
+
+HashEntry* lookup_n_hash_table(const HashTable* table, const char* key, size_t len) {
+  assert(table != NULL);
+  assert(key != NULL);
+
+  if (table->size == 0)
+    return NULL;
+
+  for (HashEntry* e = table->buckets[__hash(key, len) % table->cap]; e != NULL; e = e->next) {
+    if (__key_equals(e, key, len))
+      return e;
+  }
+
+  return NULL;
+}
+
+HashEntry* lookup_hash_table(const HashTable* table, const char* key) {
+  return lookup_n_hash_table(table, key, strlen(key));
+}
+
+HashEntry* insert_hash_table(HashTable* table, const char* key, const char* value) {
+  assert(table != NULL);
+  assert(key != NULL);
+
+  HashEntry* e = lookup_hash_table(table, key);
+
+  if (e != NULL) {
+    char* copy = (value != NULL) ? strdup(value) : NULL;
+
+    free(e->value);
+    e->value = copy;
+
+    return e;
+  }
+
+  if (table->size >= table->cap)
+    __grow(table);
+
+  e = malloc(sizeof(HashEntry));
+  e->key = strdup(key);
+  e->value = (value != NULL) ? strdup(value) : NULL;
+  e->count = 0;
+
+  size_t b = __hash(key, strlen(key)) % table->cap;
+  e->next = table->buckets[b];
+  table->buckets[b] = e;
+  table->size++;
+
+  return e;
+}
+
+bool remove_hash_table(HashTable* table, const char* key) {
+  assert(table != NULL);
+  assert(key != NULL);
+
+  if (table->size == 0)
+    return false;
+
+  HashEntry** link = &table->buckets[__hash(key, strlen(key)) % table->cap];
+
+  for (; *link != NULL; link = &(*link)->next) {
+    if (strcmp((*link)->key, key) == 0) {
+      HashEntry* e = *link;
+
+      *link = e->next;
+      __free_entry(e);
+      table->size--;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void apply_hash_table(const HashTable* table, void (*func)(HashEntry*)) {
+  assert(table != NULL);
+  assert(func != NULL);
+
+  for (size_t i = 0; i < table->cap; ++i) {
+    for (HashEntry* e = table->buckets[i]; e != NULL; e = e->next)
+      func(e);
+  }
+}
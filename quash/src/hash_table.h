@@ -0,0 +1,122 @@
+/**
+ * @file hash_table.h
+ *
+ * @brief A string keyed hash table with chained buckets
+ *
+ * Keys and values are copied into the table with strdup() and are free'd by
+ * the table. A value may be NULL, which lets the table record that a key is
+ * known to have no value.
+ */
+
+#ifndef SRC_HASH_TABLE_H
+#define SRC_HASH_TABLE_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * @brief A single key value pair stored in a @a HashTable
+ */
+typedef struct HashEntry {
+  char* key;              /**< Key the entry is stored under */
+  char* value;            /**< Value stored under @a key. May be NULL */
+  int count;              /**< Counter or flags free for use by the owner of
+                           * the table. Zero for new entries */
+  struct HashEntry* next; /**< Next entry in the same bucket */
+} HashEntry;
+
+/**
+ * @brief Hash table mapping strings to strings
+ *
+ * The structure fields should not be changed directly. Use the functions in
+ * this file instead.
+ */
+typedef struct HashTable {
+  HashEntry** buckets; /**< Array of bucket chains */
+  size_t cap;          /**< Number of buckets */
+  size_t size;         /**< Number of entries stored in the table */
+} HashTable;
+
+/**
+ * @brief Initialize an empty hash table
+ *
+ * @param table The table to initialize
+ *
+ * @param init_cap Initial number of buckets. The table grows as needed.
+ */
+void init_hash_table(HashTable* table, size_t init_cap);
+
+/**
+ * @brief Free every entry and the bucket array of a hash table
+ *
+ * @param table The table to destroy
+ */
+void destroy_hash_table(HashTable* table);
+
+/**
+ * @brief Remove every entry from a hash table without shrinking it
+ *
+ * @param table The table to empty
+ */
+void empty_hash_table(HashTable* table);
+
+/**
+ * @brief Find the entry stored under a key
+ *
+ * @param table The table to search
+ *
+ * @param key The key to look for
+ *
+ * @return The entry or NULL if @a key is not in the table
+ */
+HashEntry* lookup_hash_table(const HashTable* table, const char* key);
+
+/**
+ * @brief Find the entry stored under a key that is not null terminated
+ *
+ * @param table The table to search
+ *
+ * @param key Start of the key to look for
+ *
+ * @param len Number of characters in @a key
+ *
+ * @return The entry or NULL if the key is not in the table
+ */
+HashEntry* lookup_n_hash_table(const HashTable* table, const char* key, size_t len);
+
+/**
+ * @brief Store a value under a key, replacing any value already stored there
+ *
+ * @param table The table to insert into
+ *
+ * @param key The key to store the value under
+ *
+ * @param value The value to store. May be NULL.
+ *
+ * @return The entry holding the value. The @a count field of an existing entry
+ * is left unchanged.
+ */
+HashEntry* insert_hash_table(HashTable* table, const char* key, const char* value);
+
+/**
+ * @brief Remove the entry stored under a key
+ *
+ * @param table The table to remove from
+ *
+ * @param key The key of the entry to remove
+ *
+ * @return True if an entry was removed
+ */
+bool remove_hash_table(HashTable* table, const char* key);
+
+/**
+ * @brief Call a function on every entry in a hash table
+ *
+ * @param table The table to walk
+ *
+ * @param func Function called once per entry. It must not insert into or
+ * remove from the table.
+ */
+void apply_hash_table(const HashTable* table, void (*func)(HashEntry*));
+
+#endif
@@ -0,0 +1,703 @@
+/**
+ * @file jobs.c
+ *
+ * @brief Implements the job table
+ */
+
+// pipe2()
+#define _GNU_SOURCE
+
+#include "jobs.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define INITIAL_TABLE_CAP 16
+#define INITIAL_PROCS_CAP 4
+#define MAX_REAP_EVENTS 16
+
+// How often processes nothing can watch are checked on
+#define UNWATCHED_POLL_MS 50
+
+// Epoll key of the deadline timer. Job ids never reach the upper half.
+#define TIMER_EVENT_KEY UINT64_MAX
+
+// Epoll key of the pipe written to on SIGCHLD
+#define SIGCHLD_EVENT_KEY (UINT64_MAX - 1)
+
+// Process index in the epoll key of a job's capture pipe
+#define CAPTURE_EVENT_INDEX UINT32_MAX
+
+#define CAPTURE_READ_SIZE 4096
+
+// Slot 0 is the foreground job, background jobs start at 1
+static Job* table = NULL;
+static int table_cap = 0;
+
+// Ids below next_id have been handed out before. The freed ones wait in a min
+// heap so the lowest is reused first.
+static int next_id = FOREGROUND_JOB_ID + 1;
+static int* free_ids = NULL;
+static int num_free_ids = 0;
+static int free_ids_cap = 0;
+
+// epoll instance watching the pidfd of every running child
+static int reap_fd = -1;
+
+// Pipe the SIGCHLD handler writes to, set up once a process has no pidfd
+static int sigchld_pipe[2] = { -1, -1 };
+static size_t num_unwatched = 0;
+
+// One timer for every job deadline, armed for the earliest
+static int timer_fd = -1;
+static int num_deadlines = 0;
+
+static int running_jobs = 0;
+static int finished_jobs = 0;
+static int unreported_jobs = 0;
+
+// Epoll events carry the job id in the upper half and the process index in
+// the lower half, since the table may move
+static inline uint64_t __event_key(int job_id, size_t idx) {
+  return ((uint64_t) job_id << 32) | (uint32_t) idx;
+}
+
+static void __grow_table(int min_cap) {
+  int cap = (table_cap == 0) ? INITIAL_TABLE_CAP : table_cap;
+
+  while (cap < min_cap)
+    cap *= 2;
+
+  if (cap == table_cap)
+    return;
+
+  table = realloc(table, cap * sizeof(Job));
+  memset(table + table_cap, 0, (cap - table_cap) * sizeof(Job));
+
+  for (int i = table_cap; i < cap; ++i)
+    table[i].job_id = i;
+
+  table_cap = cap;
+}
+
+static void __push_free_id(int id) {
+  if (num_free_ids == free_ids_cap) {
+    free_ids_cap = (free_ids_cap == 0) ? INITIAL_TABLE_CAP : free_ids_cap * 2;
+    free_ids = realloc(free_ids, free_ids_cap * sizeof(int));
+  }
+
+  int i = num_free_ids++;
+
+  for (; i > 0 && free_ids[(i - 1) / 2] > id; i = (i - 1) / 2)
+    free_ids[i] = free_ids[(i - 1) / 2];
+
+  free_ids[i] = id;
+}
+
+static int __pop_free_id() {
+  int min = free_ids[0];
+  int last = free_ids[--num_free_ids];
+  int i = 0;
+
+  for (int child = 1; child < num_free_ids; child = 2 * i + 1) {
+    if (child + 1 < num_free_ids && free_ids[child + 1] < free_ids[child])
+      ++child;
+
+    if (last <= free_ids[child])
+      break;
+
+    free_ids[i] = free_ids[child];
+    i = child;
+  }
+
+  if (num_free_ids > 0)
+    free_ids[i] = last;
+
+  return min;
+}
+
+// Reset a slot for a new job, keeping its process array
+static Job* __init_job(int job_id, char* cmd_input) {
+  Job* job = &table[job_id];
+
+  job->in_use = true;
+  job->killed = false;
+  job->finished = false;
+  job->pending = false;
+  job->timed = false;
+  job->script = NULL;
+  job->pgid = 0;
+  job->cmd_input = cmd_input;
+  job->pipe_size = 0;
+  job->num_procs = 0;
+  job->num_running = 0;
+  job->status_proc = -1;
+  job->exit_status = 0;
+  memset(&job->usage, 0, sizeof(job->usage));
+  job->time_limit = 0;
+  job->kill_grace = 0;
+  job->has_deadline = false;
+  job->timed_out = false;
+  job->after = NULL;
+  job->num_after = 0;
+  job->capture_fd = -1;
+  job->log_limit = 0;
+  job->log_start = 0;
+  job->log_len = 0;
+  job->log_dropped = 0;
+  job->has_log = false;
+  job->placement = NULL;
+  clear_priority(&job->priority);
+
+  return job;
+}
+
+static void __clear_deadline(Job* job) {
+  if (job->has_deadline) {
+    job->has_deadline = false;
+    --num_deadlines;
+  }
+}
+
+// Append output to the ring buffer of a job, overwriting the oldest bytes
+static void __append_log(Job* job, const char* buf, size_t len) {
+  if (job->log_cap != job->log_limit) {
+    free(job->log);
+    job->log = malloc(job->log_limit);
+    job->log_cap = job->log_limit;
+  }
+
+  // Only the tail of a chunk larger than the whole log survives
+  if (len > job->log_cap) {
+    job->log_dropped += len - job->log_cap;
+    buf += len - job->log_cap;
+    len = job->log_cap;
+  }
+
+  size_t overflow = job->log_len + len > job->log_cap ? job->log_len + len - job->log_cap : 0;
+
+  job->log_start = (job->log_start + overflow) % job->log_cap;
+  job->log_len -= overflow;
+  job->log_dropped += overflow;
+
+  size_t end = (job->log_start + job->log_len) % job->log_cap;
+  size_t first = (job->log_cap - end < len) ? job->log_cap - end : len;
+
+  memcpy(job->log + end, buf, first);
+  memcpy(job->log, buf + first, len - first);
+  job->log_len += len;
+}
+
+static void __stop_capture(Job* job) {
+  if (job->capture_fd != -1) {
+    epoll_ctl(reap_fd, EPOLL_CTL_DEL, job->capture_fd, NULL);
+    close(job->capture_fd);
+    job->capture_fd = -1;
+  }
+}
+
+// Read everything a job has written so far. The pipe is closed at the end of
+// the output.
+static void __read_capture(Job* job) {
+  char buf[CAPTURE_READ_SIZE];
+
+  while (job->capture_fd != -1) {
+    ssize_t n = read(job->capture_fd, buf, sizeof(buf));
+
+    if (n > 0)
+      __append_log(job, buf, n);
+    else if (n == -1 && errno == EINTR)
+      continue;
+    else if (n == 0 || errno != EAGAIN)
+      __stop_capture(job);
+    else
+      break;
+  }
+}
+
+Job* new_foreground_job(char* cmd_input) {
+  if (table == NULL)
+    __grow_table(INITIAL_TABLE_CAP);
+
+  return __init_job(FOREGROUND_JOB_ID, cmd_input);
+}
+
+Job* new_background_job(char* cmd_input) {
+  int id = (num_free_ids > 0) ? __pop_free_id() : next_id++;
+
+  if (id >= table_cap)
+    __grow_table(id + 1);
+
+  return __init_job(id, cmd_input);
+}
+
+const Job* get_job_log(int job_id) {
+  if (job_id < 0 || job_id >= table_cap || !table[job_id].has_log)
+    return NULL;
+
+  return &table[job_id];
+}
+
+void write_job_log(const Job* job, int fd) {
+  // The oldest bytes run to the end of the buffer, the rest wraps around
+  size_t first = job->log_cap - job->log_start;
+
+  if (first > job->log_len)
+    first = job->log_len;
+
+  const char* parts[2] = { job->log + job->log_start, job->log };
+  size_t lens[2] = { first, job->log_len - first };
+
+  for (int i = 0; i < 2; ++i) {
+    while (lens[i] > 0) {
+      ssize_t n = write(fd, parts[i], lens[i]);
+
+      if (n == -1 && errno == EINTR)
+        continue;
+
+      if (n == -1)
+        return;
+
+      parts[i] += n;
+      lens[i] -= n;
+    }
+  }
+}
+
+Job* get_job(int job_id) {
+  if (job_id < 0 || job_id >= table_cap || !table[job_id].in_use)
+    return NULL;
+
+  return &table[job_id];
+}
+
+Job* next_background_job(const Job* job) {
+  int id = (job == NULL) ? FOREGROUND_JOB_ID + 1 : job->job_id + 1;
+
+  for (; id < next_id; ++id) {
+    if (table[id].in_use)
+      return &table[id];
+  }
+
+  return NULL;
+}
+
+void release_job(Job* job) {
+  assert(job != NULL && job->in_use);
+
+  if (job->finished && job->job_id != FOREGROUND_JOB_ID) {
+    --finished_jobs;
+
+    if (!job->killed)
+      --unreported_jobs;
+  }
+
+  __clear_deadline(job);
+  __stop_capture(job);
+  free(job->cmd_input);
+  free_script(job->script);
+  free(job->after);
+  free(job->placement);
+  job->cmd_input = NULL;
+  job->script = NULL;
+  job->after = NULL;
+  job->placement = NULL;
+  job->num_after = 0;
+  job->in_use = false;
+
+  if (job->job_id != FOREGROUND_JOB_ID)
+    __push_free_id(job->job_id);
+}
+
+int get_reap_fd() {
+  if (reap_fd == -1) {
+    reap_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (reap_fd == -1)
+      fprintf(stderr, "ERROR: Failed to create an epoll instance. Error #%d\n", errno);
+  }
+
+  return reap_fd;
+}
+
+static void __on_sigchld(int sig) {
+  int saved_errno = errno;
+  char byte = (char) sig;
+
+  // A full pipe already has a check coming
+  if (write(sigchld_pipe[1], &byte, 1) == -1) {}
+
+  errno = saved_errno;
+}
+
+// Get told about exited children through SIGCHLD. The handler is reset when a
+// child runs a program, so children are unaffected.
+static bool __watch_sigchld() {
+  if (sigchld_pipe[0] != -1)
+    return true;
+
+  if (pipe2(sigchld_pipe, O_NONBLOCK | O_CLOEXEC) == -1)
+    return false;
+
+  struct epoll_event event = { .events = EPOLLIN, .data.u64 = SIGCHLD_EVENT_KEY };
+
+  if (epoll_ctl(get_reap_fd(), EPOLL_CTL_ADD, sigchld_pipe[0], &event) == -1) {
+    close(sigchld_pipe[0]);
+    close(sigchld_pipe[1]);
+    sigchld_pipe[0] = sigchld_pipe[1] = -1;
+    return false;
+  }
+
+  struct sigaction action = { .sa_handler = __on_sigchld, .sa_flags = SA_RESTART | SA_NOCLDSTOP };
+
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGCHLD, &action, NULL);
+
+  return true;
+}
+
+void add_job_process(Job* job, pid_t pid) {
+  if (job->num_procs == job->procs_cap) {
+    job->procs_cap = (job->procs_cap == 0) ? INITIAL_PROCS_CAP : job->procs_cap * 2;
+    job->procs = realloc(job->procs, job->procs_cap * sizeof(Process));
+  }
+
+  size_t idx = job->num_procs++;
+  Process* proc = &job->procs[idx];
+
+  proc->pid = pid;
+  proc->running = true;
+  proc->cpu = -1;
+  memset(&proc->usage, 0, sizeof(proc->usage));
+
+  if (idx == 0)
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+
+  if (job->num_running++ == 0 && job->job_id != FOREGROUND_JOB_ID)
+    ++running_jobs;
+
+  // The pid can't be reused before quash reaps it, so the pidfd is always ours
+  proc->pidfd = pidfd_open(pid, 0);
+
+  struct epoll_event event = { .events = EPOLLIN, .data.u64 = __event_key(job->job_id, idx) };
+
+  if (proc->pidfd != -1 && epoll_ctl(get_reap_fd(), EPOLL_CTL_ADD, proc->pidfd, &event) == 0)
+    return;
+
+  if (proc->pidfd != -1)
+    close(proc->pidfd);
+
+  proc->pidfd = -1;
+  ++num_unwatched;
+
+  // The process may have exited before the handler was there, so it is
+  // checked on right away
+  if (__watch_sigchld())
+    __on_sigchld(SIGCHLD);
+  else
+    fprintf(stderr, "ERROR: Failed to watch process %d. Error #%d\n", pid, errno);
+}
+
+void capture_job_output(Job* job, int fd, size_t limit) {
+  struct epoll_event event = {
+    .events = EPOLLIN,
+    .data.u64 = __event_key(job->job_id, CAPTURE_EVENT_INDEX)
+  };
+
+  job->capture_fd = fd;
+  job->log_limit = limit;
+  job->has_log = true;
+
+  if (epoll_ctl(get_reap_fd(), EPOLL_CTL_ADD, fd, &event) == -1) {
+    fprintf(stderr, "ERROR: Failed to capture the output of job %d. Error #%d\n", job->job_id, errno);
+    __stop_capture(job);
+  }
+}
+
+static inline bool __before(const struct timespec* a, const struct timespec* b) {
+  return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static struct timespec __after(double seconds) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  t.tv_sec += (time_t) seconds;
+  t.tv_nsec += (long) ((seconds - (time_t) seconds) * 1e9);
+
+  if (t.tv_nsec >= 1000000000) {
+    t.tv_nsec -= 1000000000;
+    ++t.tv_sec;
+  }
+
+  return t;
+}
+
+// Arm the timer for the earliest deadline. Deadlines of jobs that finished
+// meanwhile were cleared, so a stale expiry only leads here again.
+static void __arm_timer() {
+  struct itimerspec spec = { 0 };
+  const struct timespec* next = NULL;
+
+  for (int id = 0; id < next_id && num_deadlines > 0; ++id) {
+    if (table[id].in_use && table[id].has_deadline &&
+        (next == NULL || __before(&table[id].deadline, next)))
+      next = &table[id].deadline;
+  }
+
+  // An all zero value disarms the timer
+  if (next != NULL)
+    spec.it_value = *next;
+
+  timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void start_job_deadline(Job* job) {
+  if (timer_fd == -1) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = TIMER_EVENT_KEY };
+
+    if (timer_fd == -1 || epoll_ctl(get_reap_fd(), EPOLL_CTL_ADD, timer_fd, &event) == -1) {
+      fprintf(stderr, "ERROR: Failed to create the deadline timer. Error #%d\n", errno);
+      return;
+    }
+  }
+
+  if (!job->has_deadline)
+    ++num_deadlines;
+
+  job->has_deadline = true;
+  job->deadline = __after(job->time_limit);
+
+  __arm_timer();
+}
+
+// Signal every job whose deadline has passed: TERM first, then KILL once the
+// grace period is over too
+static void __expire_deadlines() {
+  uint64_t expirations;
+  struct timespec now;
+
+  while (read(timer_fd, &expirations, sizeof(expirations)) == -1 && errno == EINTR);
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  for (int id = 0; id < next_id && num_deadlines > 0; ++id) {
+    Job* job = &table[id];
+
+    if (!job->in_use || !job->has_deadline || __before(&now, &job->deadline))
+      continue;
+
+    if (!job->timed_out) {
+      job->timed_out = true;
+      killpg(job->pgid, SIGTERM);
+
+      // A stopped job would never see the TERM
+      killpg(job->pgid, SIGCONT);
+      job->deadline = __after(job->kill_grace);
+    }
+    else {
+      killpg(job->pgid, SIGKILL);
+      __clear_deadline(job);
+    }
+  }
+
+  __arm_timer();
+}
+
+static inline void __add_timeval(struct timeval* sum, const struct timeval* t) {
+  sum->tv_sec += t->tv_sec;
+  sum->tv_usec += t->tv_usec;
+
+  if (sum->tv_usec >= 1000000) {
+    sum->tv_usec -= 1000000;
+    ++sum->tv_sec;
+  }
+}
+
+// Fold the usage of a reaped process into the totals of its job
+static void __account_process(Job* job, const struct rusage* usage) {
+  __add_timeval(&job->usage.ru_utime, &usage->ru_utime);
+  __add_timeval(&job->usage.ru_stime, &usage->ru_stime);
+
+  if (usage->ru_maxrss > job->usage.ru_maxrss)
+    job->usage.ru_maxrss = usage->ru_maxrss;
+
+  job->usage.ru_nvcsw += usage->ru_nvcsw;
+  job->usage.ru_nivcsw += usage->ru_nivcsw;
+}
+
+// Reap an exited process and update its job
+static void __reap_process(Job* job, size_t idx) {
+  Process* proc = &job->procs[idx];
+  int status;
+
+  // wait4 hands back the usage of this one child, unlike getrusage
+  while (wait4(proc->pid, &status, 0, &proc->usage) == -1 && errno == EINTR);
+
+  proc->status = status;
+
+  __account_process(job, &proc->usage);
+
+  // A forked builtin may still hold a copy of the pidfd, which would keep it
+  // in the epoll instance after it is closed here
+  if (proc->pidfd != -1) {
+    epoll_ctl(reap_fd, EPOLL_CTL_DEL, proc->pidfd, NULL);
+    close(proc->pidfd);
+  }
+  else {
+    --num_unwatched;
+  }
+
+  proc->pidfd = -1;
+  proc->running = false;
+
+  // Like other shells the status of a pipeline is the status of its last stage
+  if ((int) idx == job->status_proc) {
+    if (WIFSIGNALED(status))
+      job->exit_status = 128 + WTERMSIG(status);
+    else
+      job->exit_status = WEXITSTATUS(status);
+  }
+
+  if (--job->num_running == 0) {
+    job->finished = true;
+    clock_gettime(CLOCK_MONOTONIC, &job->ended);
+    __clear_deadline(job);
+
+    // Processes the job left behind may still hold the pipe, so only what is
+    // there now is kept
+    __read_capture(job);
+    __stop_capture(job);
+
+    // Like timeout(1), whatever the job did after its TERM
+    if (job->timed_out)
+      job->exit_status = 124;
+
+    if (job->job_id != FOREGROUND_JOB_ID) {
+      --running_jobs;
+      ++finished_jobs;
+
+      if (!job->killed)
+        ++unreported_jobs;
+    }
+  }
+}
+
+// Reap the processes without a pidfd that have exited
+static void __reap_unwatched() {
+  char buf[64];
+
+  while (sigchld_pipe[0] != -1 && read(sigchld_pipe[0], buf, sizeof(buf)) > 0);
+
+  for (int id = 0; id < next_id && num_unwatched > 0; ++id) {
+    Job* job = &table[id];
+
+    for (size_t i = 0; job->in_use && i < job->num_procs; ++i) {
+      siginfo_t info = { .si_pid = 0 };
+
+      // Only look, __reap_process() collects it
+      if (job->procs[i].running && job->procs[i].pidfd == -1 &&
+          waitid(P_PID, job->procs[i].pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 &&
+          info.si_pid != 0)
+        __reap_process(job, i);
+    }
+  }
+}
+
+int reap_exited_processes(int timeout) {
+  struct epoll_event events[MAX_REAP_EVENTS];
+
+  // Without even the SIGCHLD pipe, processes have to be checked on regularly
+  if (num_unwatched > 0 && sigchld_pipe[0] == -1 && (timeout < 0 || timeout > UNWATCHED_POLL_MS))
+    timeout = UNWATCHED_POLL_MS;
+
+  int num_events = epoll_wait(get_reap_fd(), events, MAX_REAP_EVENTS, timeout);
+
+  if (num_unwatched > 0 && sigchld_pipe[0] == -1)
+    __reap_unwatched();
+
+  for (int i = 0; i < num_events; ++i) {
+    if (events[i].data.u64 == TIMER_EVENT_KEY) {
+      __expire_deadlines();
+      continue;
+    }
+
+    if (events[i].data.u64 == SIGCHLD_EVENT_KEY) {
+      __reap_unwatched();
+      continue;
+    }
+
+    Job* job = &table[events[i].data.u64 >> 32];
+    uint32_t idx = (uint32_t) events[i].data.u64;
+
+    if (idx == CAPTURE_EVENT_INDEX)
+      __read_capture(job);
+    else if (job->procs[idx].running)
+      __reap_process(job, idx);
+  }
+
+  return num_events;
+}
+
+double job_wall_time(const Job* job) {
+  struct timespec end = job->ended;
+
+  if (job->num_procs == 0)
+    return 0.0;
+
+  if (!job->finished)
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return (end.tv_sec - job->started.tv_sec) + (end.tv_nsec - job->started.tv_nsec) / 1e9;
+}
+
+int num_running_jobs() {
+  return running_jobs;
+}
+
+int num_finished_jobs() {
+  return finished_jobs;
+}
+
+int num_unreported_jobs() {
+  return unreported_jobs;
+}
+
+void destroy_job_table() {
+  for (int i = 0; i < table_cap; ++i) {
+    free(table[i].cmd_input);
+    free_script(table[i].script);
+    free(table[i].after);
+    free(table[i].placement);
+    free(table[i].procs);
+    free(table[i].log);
+  }
+
+  free(table);
+  free(free_ids);
+
+  if (timer_fd != -1)
+    close(timer_fd);
+
+  timer_fd = -1;
+  num_deadlines = 0;
+
+  table = NULL;
+  table_cap = 0;
+  free_ids = NULL;
+  num_free_ids = free_ids_cap = 0;
+  next_id = FOREGROUND_JOB_ID + 1;
+}
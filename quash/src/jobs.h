@@ -0,0 +1,266 @@
+/**
+ * @file jobs.h
+ *
+ * @brief The job table and the reaping of the processes launched for jobs
+ *
+ * Jobs live in one contiguous table indexed by job id. Slot 0 holds the
+ * foreground job and background jobs take the lowest free id, so ids are
+ * reused as soon as a job has been reported. The processes of a job are
+ * stored inline in an array owned by its slot, which is kept when the slot
+ * is reused.
+ *
+ * Every process is watched through a pidfd registered in a single epoll
+ * instance, so an exited child costs one event no matter how many processes
+ * are running. The deadlines of jobs run under timeout share one timerfd in
+ * the same instance, armed for the earliest of them, and so do the pipes the
+ * output of background jobs is captured from. Where a pidfd can't be opened,
+ * like on kernels before 5.3, a SIGCHLD handler writes to a pipe in the same
+ * instance instead.
+ */
+
+#ifndef SRC_JOBS_H
+#define SRC_JOBS_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "command.h"
+#include "cpu_placement.h"
+#include "priority.h"
+
+/**
+ * @brief Job id of the foreground job
+ */
+#define FOREGROUND_JOB_ID (0)
+
+/**
+ * @brief A process launched for a job
+ */
+typedef struct Process {
+  pid_t pid; /**< Id of the process */
+  int pidfd; /**< Becomes readable when the process exits. -1 once the process
+              * has been reaped or if SIGCHLD watches it instead */
+  bool running; /**< The process has not been reaped yet */
+  struct rusage usage; /**< Resources used by the process and the children it
+                        * waited for. Only set once it has been reaped */
+  int status; /**< Wait status of the process once it has been reaped */
+  int cpu;    /**< CPU the process is pinned to or -1 */
+} Process;
+
+/**
+ * @brief A job and the processes launched for it
+ *
+ * Pointers to a @a Job are valid until the next call to
+ * new_background_job(), which may move the table.
+ */
+typedef struct Job {
+  int job_id;         /**< Id of the job and its index in the table */
+  bool in_use;        /**< The slot holds a job */
+  bool killed;        /**< The job was killed and is only kept until it has
+                       * been reaped */
+  bool finished;      /**< Every process of the job has been reaped */
+  bool pending;       /**< The job is queued or blocked and has not been
+                       * started yet */
+  bool timed;         /**< The job was prefixed with the time keyword */
+  CommandHolder* script; /**< Copy of the script of a pending job. See
+                          * copy_script() */
+  pid_t pgid;         /**< Process group of the job. The first process
+                       * launched leads it */
+  char* cmd_input;    /**< The command line of the job */
+  int pipe_size;      /**< Capacity of the job's pipes in bytes or 0 if it has
+                       * none */
+  Process* procs;     /**< The processes launched for the job */
+  size_t num_procs;   /**< Number of processes in @a procs */
+  size_t procs_cap;   /**< Capacity of @a procs */
+  size_t num_running; /**< Number of processes not reaped yet */
+  int status_proc;    /**< Index in @a procs of the last stage of the job or -1
+                       * if it is not a process */
+  int exit_status;    /**< Exit status of the last stage, or 128 plus the
+                       * number of the signal that terminated it */
+  struct timespec started; /**< When the first process was launched */
+  struct timespec ended;   /**< When the last process was reaped */
+  struct rusage usage; /**< Resources used by the reaped processes. Times and
+                        * context switches are summed and @a ru_maxrss is the
+                        * largest of them */
+  double time_limit;  /**< Seconds the job may run for or 0 for no limit */
+  double kill_grace;  /**< Seconds between TERM and KILL once the time limit
+                       * has passed */
+  bool has_deadline;  /**< @a deadline is armed */
+  bool timed_out;     /**< The job ran past its time limit and was sent TERM */
+  struct timespec deadline; /**< When the job is signaled next */
+  int* after;         /**< Ids of the jobs that must succeed before this
+                       * blocked job may start */
+  size_t num_after;   /**< Number of ids in @a after. The job is blocked while
+                       * it is not 0 */
+  int capture_fd;     /**< Read end of the pipe the job's output is captured
+                       * from or -1 */
+  size_t log_limit;   /**< Most bytes of captured output kept */
+  char* log;          /**< Ring buffer of the last captured output. Kept with
+                       * the slot, like @a procs */
+  size_t log_cap;     /**< Capacity of @a log */
+  size_t log_start;   /**< Index of the oldest byte in @a log */
+  size_t log_len;     /**< Number of bytes in @a log */
+  size_t log_dropped; /**< Bytes of output overwritten because the log was
+                       * full */
+  bool has_log;       /**< Output of the job was captured. Stays set after the
+                       * slot is released until it is reused */
+  CpuPlacement* placement; /**< CPUs the processes of the job run on or NULL
+                            * to leave them to the kernel */
+  JobPriority priority; /**< Priority of the processes of the job */
+} Job;
+
+/**
+ * @brief Set up the foreground job slot for a new job
+ *
+ * @param cmd_input The command line of the job. The job takes ownership of
+ * the string.
+ *
+ * @return The foreground job
+ */
+Job* new_foreground_job(char* cmd_input);
+
+/**
+ * @brief Set up a new background job under the lowest free job id
+ *
+ * @param cmd_input The command line of the job. The job takes ownership of
+ * the string.
+ *
+ * @return The new job
+ */
+Job* new_background_job(char* cmd_input);
+
+/**
+ * @brief Get the captured output of a job by its id
+ *
+ * The log of a job outlives its release until its id is reused.
+ *
+ * @param job_id The id of the job
+ *
+ * @return The slot of the job or NULL if no output was captured for that id
+ */
+const Job* get_job_log(int job_id);
+
+/**
+ * @brief Write the captured output of a job
+ *
+ * @param job A job returned by get_job_log()
+ *
+ * @param fd The descriptor to write to
+ */
+void write_job_log(const Job* job, int fd);
+
+/**
+ * @brief Get a job by its id
+ *
+ * @param job_id The id of the job
+ *
+ * @return The job or NULL if no job has that id
+ */
+Job* get_job(int job_id);
+
+/**
+ * @brief Iterate over the background jobs in job id order
+ *
+ * @param job The previous job or NULL to get the first one
+ *
+ * @return The next background job or NULL after the last one
+ */
+Job* next_background_job(const Job* job);
+
+/**
+ * @brief Free a job's slot and make its id available again
+ *
+ * @param job The job to release
+ */
+void release_job(Job* job);
+
+/**
+ * @brief Record a process launched for a job and start watching it
+ *
+ * @param job The job the process belongs to
+ *
+ * @param pid The id of the process
+ */
+void add_job_process(Job* job, pid_t pid);
+
+/**
+ * @brief Capture the output of a job in its log
+ *
+ * The pipe is read whenever quash reaps processes. Only the last @a limit
+ * bytes are kept and the buffer is only allocated once the job writes
+ * something. The pipe is drained and closed when the job finishes.
+ *
+ * @param job A launched job
+ *
+ * @param fd The non-blocking read end of the pipe the job writes to. The job
+ * takes ownership of it.
+ *
+ * @param limit Most bytes to keep
+ */
+void capture_job_output(Job* job, int fd, size_t limit);
+
+/**
+ * @brief Start the clock on a job's time limit
+ *
+ * Once @a time_limit seconds have passed the process group of the job is sent
+ * TERM, and KILL @a kill_grace seconds later if it is still running. A job that
+ * timed out exits with status 124.
+ *
+ * @param job A launched job with a @a time_limit
+ */
+void start_job_deadline(Job* job);
+
+/**
+ * @brief Reap the processes that have exited and signal the jobs whose
+ * deadline has passed
+ *
+ * @param timeout Milliseconds to wait for an event. 0 returns immediately and
+ * -1 blocks until at least one process has exited or a deadline has passed.
+ *
+ * @return The number of events handled or -1 on error
+ */
+int reap_exited_processes(int timeout);
+
+/**
+ * @brief Get a descriptor that becomes readable when a child process exits
+ *
+ * @return A descriptor to poll for reading
+ */
+int get_reap_fd();
+
+/**
+ * @brief Get the wall clock time a job has been running for
+ *
+ * @param job The job
+ *
+ * @return Seconds between the launch of the first process and the reaping of
+ * the last one, or until now if the job is still running
+ */
+double job_wall_time(const Job* job);
+
+/**
+ * @brief Get the number of background jobs that have processes running
+ */
+int num_running_jobs();
+
+/**
+ * @brief Get the number of background jobs that finished and have not been
+ * released yet
+ */
+int num_finished_jobs();
+
+/**
+ * @brief Get the number of finished background jobs that were not killed and
+ * have not been released yet
+ */
+int num_unreported_jobs();
+
+/**
+ * @brief Free the memory held by the job table
+ */
+void destroy_job_table();
+
+#endif
@@ -1937,3 +1937,10 @@ void destroy_lex() {
     yylex_destroy();
 }
 
+// Scan a stream a line at a time like a terminal, so that a job can run as
+// soon as its line has been read
+void scan_stream_by_line(FILE* stream) {
+  yyin = stream;
+  yy_set_interactive(1);
+}
+
@@ -1,8 +1,9 @@
-/* A Bison parser, made by GNU Bison 3.0.4.  */
+/* A Bison parser, made by GNU Bison 3.8.2.  */
 
 /* Bison implementation for Yacc-like parsers in C
 
-   Copyright (C) 1984, 1989-1990, 2000-2015 Free Software Foundation, Inc.
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
 
    This program is free software: you can redistribute it and/or modify
    it under the terms of the GNU General Public License as published by
@@ -15,7 +16,7 @@
    GNU General Public License for more details.
 
    You should have received a copy of the GNU General Public License
-   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
 /* As a special exception, you may create a larger work that contains
    part or all of the Bison parser skeleton and distribute that work
@@ -33,6 +34,10 @@
 /* C LALR(1) parser skeleton written by Richard Stallman, by
    simplifying the original so-called "semantic" parser.  */
 
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
 /* All symbols defined below should begin with yy or YY, to avoid
    infringing on user name space.  This should be done even for local
    variables, as they might otherwise be expanded by user macros.
@@ -40,11 +45,11 @@
    define necessary library symbols; they are noted "INFRINGES ON
    USER NAME SPACE" below.  */
 
-/* Identify Bison output.  */
-#define YYBISON 1
+/* Identify Bison output, and Bison version.  */
+#define YYBISON 30802
 
-/* Bison version.  */
-#define YYBISON_VERSION "3.0.4"
+/* Bison version string.  */
+#define YYBISON_VERSION "3.8.2"
 
 /* Skeleton name.  */
 #define YYSKELETON_NAME "yacc.c"
@@ -61,8 +66,8 @@
 
 
 
-/* Copy the first part of user declarations.  */
-#line 1 "src/parsing/parse.y" /* yacc.c:339  */
+/* First part of user prologue.  */
+#line 1 "src/parsing/parse.y"
 
 #include <string.h>
 #include <stdio.h>
@@ -81,138 +86,171 @@ extern void yyerror(CommandHolder**, char*);
 extern int yyparse(CommandHolder**);
 extern int yylex();
 
+static void mark_timed_job(Cmds* cmds);
+
 int yyerrstatus = 0;
 
-#line 87 "src/parsing/parse.tab.c" /* yacc.c:339  */
+// Set once any line of the input fails to parse
+static bool syntax_error_seen = false;
+
+#line 97 "src/parsing/parse.tab.c"
 
+# ifndef YY_CAST
+#  ifdef __cplusplus
+#   define YY_CAST(Type, Val) static_cast<Type> (Val)
+#   define YY_REINTERPRET_CAST(Type, Val) reinterpret_cast<Type> (Val)
+#  else
+#   define YY_CAST(Type, Val) ((Type) (Val))
+#   define YY_REINTERPRET_CAST(Type, Val) ((Type) (Val))
+#  endif
+# endif
 # ifndef YY_NULLPTR
-#  if defined __cplusplus && 201103L <= __cplusplus
-#   define YY_NULLPTR nullptr
+#  if defined __cplusplus
+#   if 201103L <= __cplusplus
+#    define YY_NULLPTR nullptr
+#   else
+#    define YY_NULLPTR 0
+#   endif
 #  else
-#   define YY_NULLPTR 0
+#   define YY_NULLPTR ((void*)0)
 #  endif
 # endif
 
-/* Enabling verbose error messages.  */
-#ifdef YYERROR_VERBOSE
-# undef YYERROR_VERBOSE
-# define YYERROR_VERBOSE 1
-#else
-# define YYERROR_VERBOSE 0
-#endif
-
-/* In a future release of Bison, this section will be replaced
-   by #include "parse.tab.h".  */
-#ifndef YY_YY_SRC_PARSING_PARSE_TAB_H_INCLUDED
-# define YY_YY_SRC_PARSING_PARSE_TAB_H_INCLUDED
-/* Debug traces.  */
-#ifndef YYDEBUG
-# define YYDEBUG 1
-#endif
-#if YYDEBUG
-extern int yydebug;
-#endif
-/* "%code requires" blocks.  */
-#line 22 "src/parsing/parse.y" /* yacc.c:355  */
-
-#include <stdbool.h>
-
-#include "command.h"
-#include "parsing_interface.h"
 #include "parse.tab.h"
-#include "memory_pool.h"
-
-#line 126 "src/parsing/parse.tab.c" /* yacc.c:355  */
-
-/* Token type.  */
-#ifndef YYTOKENTYPE
-# define YYTOKENTYPE
-  enum yytokentype
-  {
-    PIPE = 258,
-    BCKGRND = 259,
-    SQUOTE = 260,
-    EQUALS = 261,
-    REDIRIN = 262,
-    REDIROUT = 263,
-    REDIROUTAPP = 264,
-    END = 265,
-    ECHO_TOK = 266,
-    EXPORT_TOK = 267,
-    CD_TOK = 268,
-    PWD_TOK = 269,
-    JOBS_TOK = 270,
-    KILL_TOK = 271,
-    EOC_TOK = 272,
-    STR = 273,
-    SIM_STR = 274,
-    ID = 275,
-    NUM = 276,
-    EXIT_TOK = 277
-  };
-#endif
-
-/* Value type.  */
-#if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
-
-union YYSTYPE
+/* Symbol kind.  */
+enum yysymbol_kind_t
 {
-#line 31 "src/parsing/parse.y" /* yacc.c:355  */
-
-  int integer;
-  char* str;
-  Command cmd;
-  CommandHolder holder;
-  CommandHolder* holder_arr;
-  CmdStrs cmd_strs;
-  Cmds cmd_list;
-  Redirect redirect;
-
-#line 172 "src/parsing/parse.tab.c" /* yacc.c:355  */
+  YYSYMBOL_YYEMPTY = -2,
+  YYSYMBOL_YYEOF = 0,                      /* "end of file"  */
+  YYSYMBOL_YYerror = 1,                    /* error  */
+  YYSYMBOL_YYUNDEF = 2,                    /* "invalid token"  */
+  YYSYMBOL_PIPE = 3,                       /* PIPE  */
+  YYSYMBOL_BCKGRND = 4,                    /* BCKGRND  */
+  YYSYMBOL_SQUOTE = 5,                     /* SQUOTE  */
+  YYSYMBOL_EQUALS = 6,                     /* EQUALS  */
+  YYSYMBOL_REDIRIN = 7,                    /* REDIRIN  */
+  YYSYMBOL_REDIROUT = 8,                   /* REDIROUT  */
+  YYSYMBOL_REDIROUTAPP = 9,                /* REDIROUTAPP  */
+  YYSYMBOL_END = 10,                       /* END  */
+  YYSYMBOL_ECHO_TOK = 11,                  /* ECHO_TOK  */
+  YYSYMBOL_EXPORT_TOK = 12,                /* EXPORT_TOK  */
+  YYSYMBOL_CD_TOK = 13,                    /* CD_TOK  */
+  YYSYMBOL_PWD_TOK = 14,                   /* PWD_TOK  */
+  YYSYMBOL_JOBS_TOK = 15,                  /* JOBS_TOK  */
+  YYSYMBOL_KILL_TOK = 16,                  /* KILL_TOK  */
+  YYSYMBOL_EOC_TOK = 17,                   /* EOC_TOK  */
+  YYSYMBOL_STR = 18,                       /* STR  */
+  YYSYMBOL_SIM_STR = 19,                   /* SIM_STR  */
+  YYSYMBOL_ID = 20,                        /* ID  */
+  YYSYMBOL_NUM = 21,                       /* NUM  */
+  YYSYMBOL_EXIT_TOK = 22,                  /* EXIT_TOK  */
+  YYSYMBOL_YYACCEPT = 23,                  /* $accept  */
+  YYSYMBOL_top = 24,                       /* top  */
+  YYSYMBOL_job = 25,                       /* job  */
+  YYSYMBOL_assignment = 26,                /* assignment  */
+  YYSYMBOL_cmds = 27,                      /* cmds  */
+  YYSYMBOL_cmd_top = 28,                   /* cmd_top  */
+  YYSYMBOL_cmd_content = 29,               /* cmd_content  */
+  YYSYMBOL_redir = 30,                     /* redir  */
+  YYSYMBOL_redir_inner = 31,               /* redir_inner  */
+  YYSYMBOL_redir_mark = 32,                /* redir_mark  */
+  YYSYMBOL_cmd_bg = 33,                    /* cmd_bg  */
+  YYSYMBOL_cmd = 34,                       /* cmd  */
+  YYSYMBOL_cmd_arguments = 35,             /* cmd_arguments  */
+  YYSYMBOL_string = 36,                    /* string  */
+  YYSYMBOL_special_string = 37,            /* special_string  */
+  YYSYMBOL_first_string = 38               /* first_string  */
 };
+typedef enum yysymbol_kind_t yysymbol_kind_t;
 
-typedef union YYSTYPE YYSTYPE;
-# define YYSTYPE_IS_TRIVIAL 1
-# define YYSTYPE_IS_DECLARED 1
-#endif
 
 
-extern YYSTYPE yylval;
 
-int yyparse (CommandHolder** __ret_cmds);
+#ifdef short
+# undef short
+#endif
 
-#endif /* !YY_YY_SRC_PARSING_PARSE_TAB_H_INCLUDED  */
+/* On compilers that do not define __PTRDIFF_MAX__ etc., make sure
+   <limits.h> and (if available) <stdint.h> are included
+   so that the code can choose integer types of a good width.  */
 
-/* Copy the second part of user declarations.  */
+#ifndef __PTRDIFF_MAX__
+# include <limits.h> /* INFRINGES ON USER NAME SPACE */
+# if defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stdint.h> /* INFRINGES ON USER NAME SPACE */
+#  define YY_STDINT_H
+# endif
+#endif
 
-#line 189 "src/parsing/parse.tab.c" /* yacc.c:358  */
+/* Narrow types that promote to a signed type and that can represent a
+   signed or unsigned integer of at least N bits.  In tables they can
+   save space and decrease cache pressure.  Promoting to a signed type
+   helps avoid bugs in integer arithmetic.  */
 
-#ifdef short
-# undef short
+#ifdef __INT_LEAST8_MAX__
+typedef __INT_LEAST8_TYPE__ yytype_int8;
+#elif defined YY_STDINT_H
+typedef int_least8_t yytype_int8;
+#else
+typedef signed char yytype_int8;
 #endif
 
-#ifdef YYTYPE_UINT8
-typedef YYTYPE_UINT8 yytype_uint8;
+#ifdef __INT_LEAST16_MAX__
+typedef __INT_LEAST16_TYPE__ yytype_int16;
+#elif defined YY_STDINT_H
+typedef int_least16_t yytype_int16;
 #else
-typedef unsigned char yytype_uint8;
+typedef short yytype_int16;
 #endif
 
-#ifdef YYTYPE_INT8
-typedef YYTYPE_INT8 yytype_int8;
-#else
-typedef signed char yytype_int8;
+/* Work around bug in HP-UX 11.23, which defines these macros
+   incorrectly for preprocessor constants.  This workaround can likely
+   be removed in 2023, as HPE has promised support for HP-UX 11.23
+   (aka HP-UX 11i v2) only through the end of 2022; see Table 2 of
+   <https://h20195.www2.hpe.com/V2/getpdf.aspx/4AA4-7673ENW.pdf>.  */
+#ifdef __hpux
+# undef UINT_LEAST8_MAX
+# undef UINT_LEAST16_MAX
+# define UINT_LEAST8_MAX 255
+# define UINT_LEAST16_MAX 65535
 #endif
 
-#ifdef YYTYPE_UINT16
-typedef YYTYPE_UINT16 yytype_uint16;
+#if defined __UINT_LEAST8_MAX__ && __UINT_LEAST8_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST8_TYPE__ yytype_uint8;
+#elif (!defined __UINT_LEAST8_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST8_MAX <= INT_MAX)
+typedef uint_least8_t yytype_uint8;
+#elif !defined __UINT_LEAST8_MAX__ && UCHAR_MAX <= INT_MAX
+typedef unsigned char yytype_uint8;
 #else
-typedef unsigned short int yytype_uint16;
+typedef short yytype_uint8;
 #endif
 
-#ifdef YYTYPE_INT16
-typedef YYTYPE_INT16 yytype_int16;
+#if defined __UINT_LEAST16_MAX__ && __UINT_LEAST16_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST16_TYPE__ yytype_uint16;
+#elif (!defined __UINT_LEAST16_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST16_MAX <= INT_MAX)
+typedef uint_least16_t yytype_uint16;
+#elif !defined __UINT_LEAST16_MAX__ && USHRT_MAX <= INT_MAX
+typedef unsigned short yytype_uint16;
 #else
-typedef short int yytype_int16;
+typedef int yytype_uint16;
+#endif
+
+#ifndef YYPTRDIFF_T
+# if defined __PTRDIFF_TYPE__ && defined __PTRDIFF_MAX__
+#  define YYPTRDIFF_T __PTRDIFF_TYPE__
+#  define YYPTRDIFF_MAXIMUM __PTRDIFF_MAX__
+# elif defined PTRDIFF_MAX
+#  ifndef ptrdiff_t
+#   include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  endif
+#  define YYPTRDIFF_T ptrdiff_t
+#  define YYPTRDIFF_MAXIMUM PTRDIFF_MAX
+# else
+#  define YYPTRDIFF_T long
+#  define YYPTRDIFF_MAXIMUM LONG_MAX
+# endif
 #endif
 
 #ifndef YYSIZE_T
@@ -220,15 +258,28 @@ typedef short int yytype_int16;
 #  define YYSIZE_T __SIZE_TYPE__
 # elif defined size_t
 #  define YYSIZE_T size_t
-# elif ! defined YYSIZE_T
+# elif defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
 #  include <stddef.h> /* INFRINGES ON USER NAME SPACE */
 #  define YYSIZE_T size_t
 # else
-#  define YYSIZE_T unsigned int
+#  define YYSIZE_T unsigned
 # endif
 #endif
 
-#define YYSIZE_MAXIMUM ((YYSIZE_T) -1)
+#define YYSIZE_MAXIMUM                                  \
+  YY_CAST (YYPTRDIFF_T,                                 \
+           (YYPTRDIFF_MAXIMUM < YY_CAST (YYSIZE_T, -1)  \
+            ? YYPTRDIFF_MAXIMUM                         \
+            : YY_CAST (YYSIZE_T, -1)))
+
+#define YYSIZEOF(X) YY_CAST (YYPTRDIFF_T, sizeof (X))
+
+
+/* Stored state numbers (used for stacks). */
+typedef yytype_int8 yy_state_t;
+
+/* State numbers in computations.  */
+typedef int yy_state_fast_t;
 
 #ifndef YY_
 # if defined YYENABLE_NLS && YYENABLE_NLS
@@ -242,47 +293,43 @@ typedef short int yytype_int16;
 # endif
 #endif
 
-#ifndef YY_ATTRIBUTE
-# if (defined __GNUC__                                               \
-      && (2 < __GNUC__ || (__GNUC__ == 2 && 96 <= __GNUC_MINOR__)))  \
-     || defined __SUNPRO_C && 0x5110 <= __SUNPRO_C
-#  define YY_ATTRIBUTE(Spec) __attribute__(Spec)
-# else
-#  define YY_ATTRIBUTE(Spec) /* empty */
-# endif
-#endif
 
 #ifndef YY_ATTRIBUTE_PURE
-# define YY_ATTRIBUTE_PURE   YY_ATTRIBUTE ((__pure__))
+# if defined __GNUC__ && 2 < __GNUC__ + (96 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_PURE __attribute__ ((__pure__))
+# else
+#  define YY_ATTRIBUTE_PURE
+# endif
 #endif
 
 #ifndef YY_ATTRIBUTE_UNUSED
-# define YY_ATTRIBUTE_UNUSED YY_ATTRIBUTE ((__unused__))
-#endif
-
-#if !defined _Noreturn \
-     && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 201112)
-# if defined _MSC_VER && 1200 <= _MSC_VER
-#  define _Noreturn __declspec (noreturn)
+# if defined __GNUC__ && 2 < __GNUC__ + (7 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_UNUSED __attribute__ ((__unused__))
 # else
-#  define _Noreturn YY_ATTRIBUTE ((__noreturn__))
+#  define YY_ATTRIBUTE_UNUSED
 # endif
 #endif
 
 /* Suppress unused-variable warnings by "using" E.  */
 #if ! defined lint || defined __GNUC__
-# define YYUSE(E) ((void) (E))
+# define YY_USE(E) ((void) (E))
 #else
-# define YYUSE(E) /* empty */
+# define YY_USE(E) /* empty */
 #endif
 
-#if defined __GNUC__ && 407 <= __GNUC__ * 100 + __GNUC_MINOR__
 /* Suppress an incorrect diagnostic about yylval being uninitialized.  */
-# define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN \
-    _Pragma ("GCC diagnostic push") \
-    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")\
+#if defined __GNUC__ && ! defined __ICC && 406 <= __GNUC__ * 100 + __GNUC_MINOR__
+# if __GNUC__ * 100 + __GNUC_MINOR__ < 407
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")
+# else
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")              \
     _Pragma ("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
-# define YY_IGNORE_MAYBE_UNINITIALIZED_END \
+# endif
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END      \
     _Pragma ("GCC diagnostic pop")
 #else
 # define YY_INITIAL_VALUE(Value) Value
@@ -295,8 +342,22 @@ typedef short int yytype_int16;
 # define YY_INITIAL_VALUE(Value) /* Nothing. */
 #endif
 
+#if defined __cplusplus && defined __GNUC__ && ! defined __ICC && 6 <= __GNUC__
+# define YY_IGNORE_USELESS_CAST_BEGIN                          \
+    _Pragma ("GCC diagnostic push")                            \
+    _Pragma ("GCC diagnostic ignored \"-Wuseless-cast\"")
+# define YY_IGNORE_USELESS_CAST_END            \
+    _Pragma ("GCC diagnostic pop")
+#endif
+#ifndef YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_END
+#endif
+
+
+#define YY_ASSERT(E) ((void) (0 && (E)))
 
-#if ! defined yyoverflow || YYERROR_VERBOSE
+#if !defined yyoverflow
 
 /* The parser invokes alloca or malloc; define the necessary symbols.  */
 
@@ -361,8 +422,7 @@ void free (void *); /* INFRINGES ON USER NAME SPACE */
 #   endif
 #  endif
 # endif
-#endif /* ! defined yyoverflow || YYERROR_VERBOSE */
-
+#endif /* !defined yyoverflow */
 
 #if (! defined yyoverflow \
      && (! defined __cplusplus \
@@ -371,17 +431,17 @@ void free (void *); /* INFRINGES ON USER NAME SPACE */
 /* A type that is properly aligned for any stack member.  */
 union yyalloc
 {
-  yytype_int16 yyss_alloc;
+  yy_state_t yyss_alloc;
   YYSTYPE yyvs_alloc;
 };
 
 /* The size of the maximum gap between one aligned stack and the next.  */
-# define YYSTACK_GAP_MAXIMUM (sizeof (union yyalloc) - 1)
+# define YYSTACK_GAP_MAXIMUM (YYSIZEOF (union yyalloc) - 1)
 
 /* The size of an array large to enough to hold all stacks, each with
    N elements.  */
 # define YYSTACK_BYTES(N) \
-     ((N) * (sizeof (yytype_int16) + sizeof (YYSTYPE)) \
+     ((N) * (YYSIZEOF (yy_state_t) + YYSIZEOF (YYSTYPE)) \
       + YYSTACK_GAP_MAXIMUM)
 
 # define YYCOPY_NEEDED 1
@@ -394,11 +454,11 @@ union yyalloc
 # define YYSTACK_RELOCATE(Stack_alloc, Stack)                           \
     do                                                                  \
       {                                                                 \
-        YYSIZE_T yynewbytes;                                            \
+        YYPTRDIFF_T yynewbytes;                                         \
         YYCOPY (&yyptr->Stack_alloc, Stack, yysize);                    \
         Stack = &yyptr->Stack_alloc;                                    \
-        yynewbytes = yystacksize * sizeof (*Stack) + YYSTACK_GAP_MAXIMUM; \
-        yyptr += yynewbytes / sizeof (*yyptr);                          \
+        yynewbytes = yystacksize * YYSIZEOF (*Stack) + YYSTACK_GAP_MAXIMUM; \
+        yyptr += yynewbytes / YYSIZEOF (*yyptr);                        \
       }                                                                 \
     while (0)
 
@@ -410,12 +470,12 @@ union yyalloc
 # ifndef YYCOPY
 #  if defined __GNUC__ && 1 < __GNUC__
 #   define YYCOPY(Dst, Src, Count) \
-      __builtin_memcpy (Dst, Src, (Count) * sizeof (*(Src)))
+      __builtin_memcpy (Dst, Src, YY_CAST (YYSIZE_T, (Count)) * sizeof (*(Src)))
 #  else
 #   define YYCOPY(Dst, Src, Count)              \
       do                                        \
         {                                       \
-          YYSIZE_T yyi;                         \
+          YYPTRDIFF_T yyi;                      \
           for (yyi = 0; yyi < (Count); yyi++)   \
             (Dst)[yyi] = (Src)[yyi];            \
         }                                       \
@@ -425,30 +485,33 @@ union yyalloc
 #endif /* !YYCOPY_NEEDED */
 
 /* YYFINAL -- State number of the termination state.  */
-#define YYFINAL  36
+#define YYFINAL  42
 /* YYLAST -- Last index in YYTABLE.  */
-#define YYLAST   58
+#define YYLAST   75
 
 /* YYNTOKENS -- Number of terminals.  */
 #define YYNTOKENS  23
 /* YYNNTS -- Number of nonterminals.  */
-#define YYNNTS  14
+#define YYNNTS  16
 /* YYNRULES -- Number of rules.  */
-#define YYNRULES  45
+#define YYNRULES  52
 /* YYNSTATES -- Number of states.  */
-#define YYNSTATES  56
+#define YYNSTATES  64
 
-/* YYTRANSLATE[YYX] -- Symbol number corresponding to YYX as returned
-   by yylex, with out-of-bounds checking.  */
-#define YYUNDEFTOK  2
+/* YYMAXUTOK -- Last valid token kind.  */
 #define YYMAXUTOK   277
 
-#define YYTRANSLATE(YYX)                                                \
-  ((unsigned int) (YYX) <= YYMAXUTOK ? yytranslate[YYX] : YYUNDEFTOK)
+
+/* YYTRANSLATE(TOKEN-NUM) -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex, with out-of-bounds checking.  */
+#define YYTRANSLATE(YYX)                                \
+  (0 <= (YYX) && (YYX) <= YYMAXUTOK                     \
+   ? YY_CAST (yysymbol_kind_t, yytranslate[YYX])        \
+   : YYSYMBOL_YYUNDEF)
 
 /* YYTRANSLATE[TOKEN-NUM] -- Symbol number corresponding to TOKEN-NUM
-   as returned by yylex, without out-of-bounds checking.  */
-static const yytype_uint8 yytranslate[] =
+   as returned by yylex.  */
+static const yytype_int8 yytranslate[] =
 {
        0,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
@@ -481,180 +544,193 @@ static const yytype_uint8 yytranslate[] =
 };
 
 #if YYDEBUG
-  /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
-static const yytype_uint16 yyrline[] =
+/* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
+static const yytype_int16 yyrline[] =
 {
-       0,    64,    64,    69,    76,    85,    90,   100,   107,   124,
-     135,   138,   143,   146,   149,   152,   163,   166,   169,   172,
-     176,   179,   185,   200,   217,   220,   223,   229,   232,   238,
-     243,   254,   262,   270,   273,   277,   280,   283,   286,   289,
-     292,   295,   299,   302,   305,   308
+       0,    69,    69,    74,    81,    89,    99,   104,   114,   117,
+     124,   135,   141,   148,   165,   176,   179,   184,   187,   190,
+     193,   197,   201,   204,   209,   212,   215,   219,   222,   228,
+     243,   260,   263,   266,   272,   275,   281,   286,   297,   305,
+     313,   316,   320,   323,   326,   329,   332,   335,   338,   342,
+     345,   348,   351
 };
 #endif
 
-#if YYDEBUG || YYERROR_VERBOSE || 0
+/** Accessing symbol of state STATE.  */
+#define YY_ACCESSING_SYMBOL(State) YY_CAST (yysymbol_kind_t, yystos[State])
+
+#if YYDEBUG || 0
+/* The user-facing name of the symbol whose (internal) number is
+   YYSYMBOL.  No bounds checking.  */
+static const char *yysymbol_name (yysymbol_kind_t yysymbol) YY_ATTRIBUTE_UNUSED;
+
 /* YYTNAME[SYMBOL-NUM] -- String name of the symbol SYMBOL-NUM.
    First, the terminals, then, starting at YYNTOKENS, nonterminals.  */
 static const char *const yytname[] =
 {
-  "$end", "error", "$undefined", "PIPE", "BCKGRND", "SQUOTE", "EQUALS",
-  "REDIRIN", "REDIROUT", "REDIROUTAPP", "END", "ECHO_TOK", "EXPORT_TOK",
-  "CD_TOK", "PWD_TOK", "JOBS_TOK", "KILL_TOK", "EOC_TOK", "STR", "SIM_STR",
-  "ID", "NUM", "EXIT_TOK", "$accept", "top", "cmds", "cmd_top",
-  "cmd_content", "redir", "redir_inner", "redir_mark", "cmd_bg", "cmd",
-  "cmd_arguments", "string", "special_string", "first_string", YY_NULLPTR
+  "\"end of file\"", "error", "\"invalid token\"", "PIPE", "BCKGRND",
+  "SQUOTE", "EQUALS", "REDIRIN", "REDIROUT", "REDIROUTAPP", "END",
+  "ECHO_TOK", "EXPORT_TOK", "CD_TOK", "PWD_TOK", "JOBS_TOK", "KILL_TOK",
+  "EOC_TOK", "STR", "SIM_STR", "ID", "NUM", "EXIT_TOK", "$accept", "top",
+  "job", "assignment", "cmds", "cmd_top", "cmd_content", "redir",
+  "redir_inner", "redir_mark", "cmd_bg", "cmd", "cmd_arguments", "string",
+  "special_string", "first_string", YY_NULLPTR
 };
-#endif
 
-# ifdef YYPRINT
-/* YYTOKNUM[NUM] -- (External) token number corresponding to the
-   (internal) symbol number NUM (which must be that of a token).  */
-static const yytype_uint16 yytoknum[] =
+static const char *
+yysymbol_name (yysymbol_kind_t yysymbol)
 {
-       0,   256,   257,   258,   259,   260,   261,   262,   263,   264,
-     265,   266,   267,   268,   269,   270,   271,   272,   273,   274,
-     275,   276,   277
-};
-# endif
+  return yytname[yysymbol];
+}
+#endif
 
-#define YYPACT_NINF -13
+#define YYPACT_NINF (-13)
 
-#define yypact_value_is_default(Yystate) \
-  (!!((Yystate) == (-13)))
+#define yypact_value_is_default(Yyn) \
+  ((Yyn) == YYPACT_NINF)
 
-#define YYTABLE_NINF -1
+#define YYTABLE_NINF (-1)
 
-#define yytable_value_is_error(Yytable_value) \
+#define yytable_value_is_error(Yyn) \
   0
 
-  /* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
-     STATE-NUM.  */
+/* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
+   STATE-NUM.  */
 static const yytype_int8 yypact[] =
 {
-       2,    -8,    14,   -12,    14,   -13,   -13,   -11,   -13,   -13,
-     -13,   -13,   -13,   -13,    37,    -6,     9,    -2,   -13,    14,
-     -13,   -13,   -13,   -13,   -13,   -13,   -13,   -13,   -13,   -13,
-      14,   -13,   -13,    32,   -13,    18,   -13,   -13,   -13,    34,
-     -13,   -13,   -13,    39,   -13,    14,   -13,   -13,    14,   -13,
-     -13,   -13,   -13,    -2,   -13,   -13
+      41,    24,   -13,    -8,   -11,    -8,   -13,    -8,    -4,   -13,
+     -13,   -13,     9,   -13,   -13,    18,    27,    11,   -13,    17,
+      31,   -13,    -8,   -13,   -13,   -13,   -13,   -13,   -13,   -13,
+     -13,   -13,   -13,   -13,    -8,   -13,   -13,    15,   -13,   -13,
+      14,    -8,   -13,   -13,   -13,   -13,    53,   -13,   -13,   -13,
+      39,   -13,    -8,   -13,   -13,    -8,   -13,   -13,   -13,   -13,
+     -13,    31,   -13,   -13
 };
 
-  /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
-     Performed when YYTABLE does not specify something else to do.  Zero
-     means the default is an error.  */
-static const yytype_uint8 yydefact[] =
+/* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
+   Performed when YYTABLE does not specify something else to do.  Zero
+   means the default is an error.  */
+static const yytype_int8 yydefact[] =
 {
-       0,     0,    11,     0,    14,    16,    17,     0,     2,    42,
-      43,    45,    44,    18,     0,     0,     7,    21,    10,    30,
-       6,     5,    35,    36,    37,    39,    40,    38,    41,    12,
-      31,    34,    33,     0,    15,     0,     1,     4,     3,     0,
-      24,    25,    26,    27,    20,     0,    29,    32,     0,    19,
-       8,    28,     9,    23,    13,    22
+       0,     0,     3,    16,     0,    20,    22,    23,     0,     2,
+      49,    50,    52,    51,    25,     0,     0,     9,     8,    12,
+      28,    15,    37,     7,     6,    42,    43,    44,    46,    47,
+      45,    52,    48,    17,    38,    41,    40,    19,    21,    24,
+       0,     0,     1,     5,     4,    10,     0,    31,    32,    33,
+      34,    27,     0,    36,    39,     0,    26,    11,    13,    35,
+      14,    30,    18,    29
 };
 
-  /* YYPGOTO[NTERM-NUM].  */
+/* YYPGOTO[NTERM-NUM].  */
 static const yytype_int8 yypgoto[] =
 {
-     -13,   -13,    19,   -13,   -13,   -13,     4,   -13,   -13,   -13,
-      12,    -4,   -13,     1
+     -13,   -13,    28,   -13,     0,   -13,   -13,   -13,   -12,   -13,
+     -13,   -13,    -6,    -5,   -13,     2
 };
 
-  /* YYDEFGOTO[NTERM-NUM].  */
+/* YYDEFGOTO[NTERM-NUM].  */
 static const yytype_int8 yydefgoto[] =
 {
-      -1,    14,    15,    16,    17,    43,    44,    45,    52,    18,
-      29,    30,    31,    32
+       0,    15,    16,    17,    18,    19,    20,    50,    51,    52,
+      60,    21,    33,    34,    35,    36
 };
 
-  /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
-     positive, shift that token.  If negative, reduce the rule whose
-     number is the opposite.  If YYTABLE_NINF, syntax error.  */
-static const yytype_uint8 yytable[] =
+/* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
+   positive, shift that token.  If negative, reduce the rule whose
+   number is the opposite.  If YYTABLE_NINF, syntax error.  */
+static const yytype_int8 yytable[] =
 {
-      34,    19,    20,     1,    37,    40,    41,    42,    33,    21,
-      35,    38,    39,     2,     3,     4,     5,     6,     7,     8,
-       9,    10,    11,    12,    13,    22,    23,    24,    25,    26,
-      27,    46,     9,    10,    11,    12,    28,    36,    48,    49,
-      19,    53,    47,    51,    54,     2,     3,     4,     5,     6,
-       7,     0,     9,    10,    11,    12,    13,    55,    50
+      38,    39,    22,    25,    26,    27,    28,    29,    30,    37,
+      10,    11,    31,    13,    32,    41,    53,    40,    42,    22,
+      46,    55,     3,     4,     5,     6,     7,     8,    54,    10,
+      11,    12,    13,    14,    23,    56,    57,    43,    47,    48,
+      49,    24,     1,    59,    44,    45,    58,    61,    22,    63,
+      62,     2,     3,     4,     5,     6,     7,     8,     9,    10,
+      11,    12,    13,    14,     3,     4,     5,     6,     7,     8,
+       0,    10,    11,    31,    13,    14
 };
 
 static const yytype_int8 yycheck[] =
 {
-       4,     0,    10,     1,    10,     7,     8,     9,    20,    17,
-      21,    17,     3,    11,    12,    13,    14,    15,    16,    17,
-      18,    19,    20,    21,    22,    11,    12,    13,    14,    15,
-      16,    19,    18,    19,    20,    21,    22,     0,     6,    21,
-      39,    45,    30,     4,    48,    11,    12,    13,    14,    15,
-      16,    -1,    18,    19,    20,    21,    22,    53,    39
+       5,     7,     0,    11,    12,    13,    14,    15,    16,    20,
+      18,    19,    20,    21,    22,     6,    22,    21,     0,    17,
+       3,     6,    11,    12,    13,    14,    15,    16,    34,    18,
+      19,    20,    21,    22,    10,    21,    41,    10,     7,     8,
+       9,    17,     1,     4,    17,    17,    46,    52,    46,    61,
+      55,    10,    11,    12,    13,    14,    15,    16,    17,    18,
+      19,    20,    21,    22,    11,    12,    13,    14,    15,    16,
+      -1,    18,    19,    20,    21,    22
 };
 
-  /* YYSTOS[STATE-NUM] -- The (internal number of the) accessing
-     symbol of state STATE-NUM.  */
-static const yytype_uint8 yystos[] =
+/* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
+   state STATE-NUM.  */
+static const yytype_int8 yystos[] =
 {
-       0,     1,    11,    12,    13,    14,    15,    16,    17,    18,
-      19,    20,    21,    22,    24,    25,    26,    27,    32,    36,
-      10,    17,    11,    12,    13,    14,    15,    16,    22,    33,
-      34,    35,    36,    20,    34,    21,     0,    10,    17,     3,
-       7,     8,     9,    28,    29,    30,    33,    33,     6,    21,
-      25,     4,    31,    34,    34,    29
+       0,     1,    10,    11,    12,    13,    14,    15,    16,    17,
+      18,    19,    20,    21,    22,    24,    25,    26,    27,    28,
+      29,    34,    38,    10,    17,    11,    12,    13,    14,    15,
+      16,    20,    22,    35,    36,    37,    38,    20,    36,    35,
+      21,     6,     0,    10,    17,    25,     3,     7,     8,     9,
+      30,    31,    32,    35,    35,     6,    21,    36,    27,     4,
+      33,    36,    36,    31
 };
 
-  /* YYR1[YYN] -- Symbol number of symbol that rule YYN derives.  */
-static const yytype_uint8 yyr1[] =
+/* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr1[] =
 {
-       0,    23,    24,    24,    24,    24,    24,    25,    25,    26,
-      27,    27,    27,    27,    27,    27,    27,    27,    27,    27,
-      28,    28,    29,    29,    30,    30,    30,    31,    31,    32,
-      32,    33,    33,    34,    34,    35,    35,    35,    35,    35,
-      35,    35,    36,    36,    36,    36
+       0,    23,    24,    24,    24,    24,    24,    24,    25,    25,
+      25,    26,    27,    27,    28,    29,    29,    29,    29,    29,
+      29,    29,    29,    29,    29,    29,    29,    30,    30,    31,
+      31,    32,    32,    32,    33,    33,    34,    34,    35,    35,
+      36,    36,    37,    37,    37,    37,    37,    37,    37,    38,
+      38,    38,    38
 };
 
-  /* YYR2[YYN] -- Number of symbols on the right hand side of rule YYN.  */
-static const yytype_uint8 yyr2[] =
+/* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr2[] =
 {
-       0,     2,     1,     2,     2,     2,     2,     1,     3,     3,
-       1,     1,     2,     4,     1,     2,     1,     1,     1,     3,
-       1,     0,     3,     2,     1,     1,     1,     0,     1,     2,
-       1,     1,     2,     1,     1,     1,     1,     1,     1,     1,
-       1,     1,     1,     1,     1,     1
+       0,     2,     1,     1,     2,     2,     2,     2,     1,     1,
+       2,     3,     1,     3,     3,     1,     1,     2,     4,     2,
+       1,     2,     1,     1,     2,     1,     3,     1,     0,     3,
+       2,     1,     1,     1,     0,     1,     2,     1,     1,     2,
+       1,     1,     1,     1,     1,     1,     1,     1,     1,     1,
+       1,     1,     1
 };
 
 
+enum { YYENOMEM = -2 };
+
 #define yyerrok         (yyerrstatus = 0)
 #define yyclearin       (yychar = YYEMPTY)
-#define YYEMPTY         (-2)
-#define YYEOF           0
 
 #define YYACCEPT        goto yyacceptlab
 #define YYABORT         goto yyabortlab
 #define YYERROR         goto yyerrorlab
+#define YYNOMEM         goto yyexhaustedlab
 
 
 #define YYRECOVERING()  (!!yyerrstatus)
 
-#define YYBACKUP(Token, Value)                                  \
-do                                                              \
-  if (yychar == YYEMPTY)                                        \
-    {                                                           \
-      yychar = (Token);                                         \
-      yylval = (Value);                                         \
-      YYPOPSTACK (yylen);                                       \
-      yystate = *yyssp;                                         \
-      goto yybackup;                                            \
-    }                                                           \
-  else                                                          \
-    {                                                           \
-      yyerror (__ret_cmds, YY_("syntax error: cannot back up")); \
-      YYERROR;                                                  \
-    }                                                           \
-while (0)
-
-/* Error token number */
-#define YYTERROR        1
-#define YYERRCODE       256
-
+#define YYBACKUP(Token, Value)                                    \
+  do                                                              \
+    if (yychar == YYEMPTY)                                        \
+      {                                                           \
+        yychar = (Token);                                         \
+        yylval = (Value);                                         \
+        YYPOPSTACK (yylen);                                       \
+        yystate = *yyssp;                                         \
+        goto yybackup;                                            \
+      }                                                           \
+    else                                                          \
+      {                                                           \
+        yyerror (__ret_cmds, YY_("syntax error: cannot back up")); \
+        YYERROR;                                                  \
+      }                                                           \
+  while (0)
+
+/* Backward compatibility with an undocumented macro.
+   Use YYerror or YYUNDEF. */
+#define YYERRCODE YYUNDEF
 
 
 /* Enable debugging if requested.  */
@@ -671,56 +747,53 @@ do {                                            \
     YYFPRINTF Args;                             \
 } while (0)
 
-/* This macro is provided for backward compatibility. */
-#ifndef YY_LOCATION_PRINT
-# define YY_LOCATION_PRINT(File, Loc) ((void) 0)
-#endif
 
 
-# define YY_SYMBOL_PRINT(Title, Type, Value, Location)                    \
+
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)                    \
 do {                                                                      \
   if (yydebug)                                                            \
     {                                                                     \
       YYFPRINTF (stderr, "%s ", Title);                                   \
       yy_symbol_print (stderr,                                            \
-                  Type, Value, __ret_cmds); \
+                  Kind, Value, __ret_cmds); \
       YYFPRINTF (stderr, "\n");                                           \
     }                                                                     \
 } while (0)
 
 
-/*----------------------------------------.
-| Print this symbol's value on YYOUTPUT.  |
-`----------------------------------------*/
+/*-----------------------------------.
+| Print this symbol's value on YYO.  |
+`-----------------------------------*/
 
 static void
-yy_symbol_value_print (FILE *yyoutput, int yytype, YYSTYPE const * const yyvaluep, CommandHolder** __ret_cmds)
+yy_symbol_value_print (FILE *yyo,
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, CommandHolder** __ret_cmds)
 {
-  FILE *yyo = yyoutput;
-  YYUSE (yyo);
-  YYUSE (__ret_cmds);
+  FILE *yyoutput = yyo;
+  YY_USE (yyoutput);
+  YY_USE (__ret_cmds);
   if (!yyvaluep)
     return;
-# ifdef YYPRINT
-  if (yytype < YYNTOKENS)
-    YYPRINT (yyoutput, yytoknum[yytype], *yyvaluep);
-# endif
-  YYUSE (yytype);
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  YY_USE (yykind);
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
 }
 
 
-/*--------------------------------.
-| Print this symbol on YYOUTPUT.  |
-`--------------------------------*/
+/*---------------------------.
+| Print this symbol on YYO.  |
+`---------------------------*/
 
 static void
-yy_symbol_print (FILE *yyoutput, int yytype, YYSTYPE const * const yyvaluep, CommandHolder** __ret_cmds)
+yy_symbol_print (FILE *yyo,
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, CommandHolder** __ret_cmds)
 {
-  YYFPRINTF (yyoutput, "%s %s (",
-             yytype < YYNTOKENS ? "token" : "nterm", yytname[yytype]);
+  YYFPRINTF (yyo, "%s %s (",
+             yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
 
-  yy_symbol_value_print (yyoutput, yytype, yyvaluep, __ret_cmds);
-  YYFPRINTF (yyoutput, ")");
+  yy_symbol_value_print (yyo, yykind, yyvaluep, __ret_cmds);
+  YYFPRINTF (yyo, ")");
 }
 
 /*------------------------------------------------------------------.
@@ -729,7 +802,7 @@ yy_symbol_print (FILE *yyoutput, int yytype, YYSTYPE const * const yyvaluep, Com
 `------------------------------------------------------------------*/
 
 static void
-yy_stack_print (yytype_int16 *yybottom, yytype_int16 *yytop)
+yy_stack_print (yy_state_t *yybottom, yy_state_t *yytop)
 {
   YYFPRINTF (stderr, "Stack now");
   for (; yybottom <= yytop; yybottom++)
@@ -752,21 +825,21 @@ do {                                                            \
 `------------------------------------------------*/
 
 static void
-yy_reduce_print (yytype_int16 *yyssp, YYSTYPE *yyvsp, int yyrule, CommandHolder** __ret_cmds)
+yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
+                 int yyrule, CommandHolder** __ret_cmds)
 {
-  unsigned long int yylno = yyrline[yyrule];
+  int yylno = yyrline[yyrule];
   int yynrhs = yyr2[yyrule];
   int yyi;
-  YYFPRINTF (stderr, "Reducing stack by rule %d (line %lu):\n",
+  YYFPRINTF (stderr, "Reducing stack by rule %d (line %d):\n",
              yyrule - 1, yylno);
   /* The symbols being reduced.  */
   for (yyi = 0; yyi < yynrhs; yyi++)
     {
       YYFPRINTF (stderr, "   $%d = ", yyi + 1);
       yy_symbol_print (stderr,
-                       yystos[yyssp[yyi + 1 - yynrhs]],
-                       &(yyvsp[(yyi + 1) - (yynrhs)])
-                                              , __ret_cmds);
+                       YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
+                       &yyvsp[(yyi + 1) - (yynrhs)], __ret_cmds);
       YYFPRINTF (stderr, "\n");
     }
 }
@@ -781,8 +854,8 @@ do {                                    \
    multiple parsers can coexist.  */
 int yydebug;
 #else /* !YYDEBUG */
-# define YYDPRINTF(Args)
-# define YY_SYMBOL_PRINT(Title, Type, Value, Location)
+# define YYDPRINTF(Args) ((void) 0)
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)
 # define YY_STACK_PRINT(Bottom, Top)
 # define YY_REDUCE_PRINT(Rule)
 #endif /* !YYDEBUG */
@@ -805,250 +878,31 @@ int yydebug;
 #endif
 
 
-#if YYERROR_VERBOSE
-
-# ifndef yystrlen
-#  if defined __GLIBC__ && defined _STRING_H
-#   define yystrlen strlen
-#  else
-/* Return the length of YYSTR.  */
-static YYSIZE_T
-yystrlen (const char *yystr)
-{
-  YYSIZE_T yylen;
-  for (yylen = 0; yystr[yylen]; yylen++)
-    continue;
-  return yylen;
-}
-#  endif
-# endif
-
-# ifndef yystpcpy
-#  if defined __GLIBC__ && defined _STRING_H && defined _GNU_SOURCE
-#   define yystpcpy stpcpy
-#  else
-/* Copy YYSRC to YYDEST, returning the address of the terminating '\0' in
-   YYDEST.  */
-static char *
-yystpcpy (char *yydest, const char *yysrc)
-{
-  char *yyd = yydest;
-  const char *yys = yysrc;
-
-  while ((*yyd++ = *yys++) != '\0')
-    continue;
-
-  return yyd - 1;
-}
-#  endif
-# endif
-
-# ifndef yytnamerr
-/* Copy to YYRES the contents of YYSTR after stripping away unnecessary
-   quotes and backslashes, so that it's suitable for yyerror.  The
-   heuristic is that double-quoting is unnecessary unless the string
-   contains an apostrophe, a comma, or backslash (other than
-   backslash-backslash).  YYSTR is taken from yytname.  If YYRES is
-   null, do not copy; instead, return the length of what the result
-   would have been.  */
-static YYSIZE_T
-yytnamerr (char *yyres, const char *yystr)
-{
-  if (*yystr == '"')
-    {
-      YYSIZE_T yyn = 0;
-      char const *yyp = yystr;
-
-      for (;;)
-        switch (*++yyp)
-          {
-          case '\'':
-          case ',':
-            goto do_not_strip_quotes;
-
-          case '\\':
-            if (*++yyp != '\\')
-              goto do_not_strip_quotes;
-            /* Fall through.  */
-          default:
-            if (yyres)
-              yyres[yyn] = *yyp;
-            yyn++;
-            break;
-
-          case '"':
-            if (yyres)
-              yyres[yyn] = '\0';
-            return yyn;
-          }
-    do_not_strip_quotes: ;
-    }
-
-  if (! yyres)
-    return yystrlen (yystr);
-
-  return yystpcpy (yyres, yystr) - yyres;
-}
-# endif
-
-/* Copy into *YYMSG, which is of size *YYMSG_ALLOC, an error message
-   about the unexpected token YYTOKEN for the state stack whose top is
-   YYSSP.
-
-   Return 0 if *YYMSG was successfully written.  Return 1 if *YYMSG is
-   not large enough to hold the message.  In that case, also set
-   *YYMSG_ALLOC to the required number of bytes.  Return 2 if the
-   required number of bytes is too large to store.  */
-static int
-yysyntax_error (YYSIZE_T *yymsg_alloc, char **yymsg,
-                yytype_int16 *yyssp, int yytoken)
-{
-  YYSIZE_T yysize0 = yytnamerr (YY_NULLPTR, yytname[yytoken]);
-  YYSIZE_T yysize = yysize0;
-  enum { YYERROR_VERBOSE_ARGS_MAXIMUM = 5 };
-  /* Internationalized format string. */
-  const char *yyformat = YY_NULLPTR;
-  /* Arguments of yyformat. */
-  char const *yyarg[YYERROR_VERBOSE_ARGS_MAXIMUM];
-  /* Number of reported tokens (one for the "unexpected", one per
-     "expected"). */
-  int yycount = 0;
-
-  /* There are many possibilities here to consider:
-     - If this state is a consistent state with a default action, then
-       the only way this function was invoked is if the default action
-       is an error action.  In that case, don't check for expected
-       tokens because there are none.
-     - The only way there can be no lookahead present (in yychar) is if
-       this state is a consistent state with a default action.  Thus,
-       detecting the absence of a lookahead is sufficient to determine
-       that there is no unexpected or expected token to report.  In that
-       case, just report a simple "syntax error".
-     - Don't assume there isn't a lookahead just because this state is a
-       consistent state with a default action.  There might have been a
-       previous inconsistent state, consistent state with a non-default
-       action, or user semantic action that manipulated yychar.
-     - Of course, the expected token list depends on states to have
-       correct lookahead information, and it depends on the parser not
-       to perform extra reductions after fetching a lookahead from the
-       scanner and before detecting a syntax error.  Thus, state merging
-       (from LALR or IELR) and default reductions corrupt the expected
-       token list.  However, the list is correct for canonical LR with
-       one exception: it will still contain any token that will not be
-       accepted due to an error action in a later state.
-  */
-  if (yytoken != YYEMPTY)
-    {
-      int yyn = yypact[*yyssp];
-      yyarg[yycount++] = yytname[yytoken];
-      if (!yypact_value_is_default (yyn))
-        {
-          /* Start YYX at -YYN if negative to avoid negative indexes in
-             YYCHECK.  In other words, skip the first -YYN actions for
-             this state because they are default actions.  */
-          int yyxbegin = yyn < 0 ? -yyn : 0;
-          /* Stay within bounds of both yycheck and yytname.  */
-          int yychecklim = YYLAST - yyn + 1;
-          int yyxend = yychecklim < YYNTOKENS ? yychecklim : YYNTOKENS;
-          int yyx;
-
-          for (yyx = yyxbegin; yyx < yyxend; ++yyx)
-            if (yycheck[yyx + yyn] == yyx && yyx != YYTERROR
-                && !yytable_value_is_error (yytable[yyx + yyn]))
-              {
-                if (yycount == YYERROR_VERBOSE_ARGS_MAXIMUM)
-                  {
-                    yycount = 1;
-                    yysize = yysize0;
-                    break;
-                  }
-                yyarg[yycount++] = yytname[yyx];
-                {
-                  YYSIZE_T yysize1 = yysize + yytnamerr (YY_NULLPTR, yytname[yyx]);
-                  if (! (yysize <= yysize1
-                         && yysize1 <= YYSTACK_ALLOC_MAXIMUM))
-                    return 2;
-                  yysize = yysize1;
-                }
-              }
-        }
-    }
-
-  switch (yycount)
-    {
-# define YYCASE_(N, S)                      \
-      case N:                               \
-        yyformat = S;                       \
-      break
-      YYCASE_(0, YY_("syntax error"));
-      YYCASE_(1, YY_("syntax error, unexpected %s"));
-      YYCASE_(2, YY_("syntax error, unexpected %s, expecting %s"));
-      YYCASE_(3, YY_("syntax error, unexpected %s, expecting %s or %s"));
-      YYCASE_(4, YY_("syntax error, unexpected %s, expecting %s or %s or %s"));
-      YYCASE_(5, YY_("syntax error, unexpected %s, expecting %s or %s or %s or %s"));
-# undef YYCASE_
-    }
 
-  {
-    YYSIZE_T yysize1 = yysize + yystrlen (yyformat);
-    if (! (yysize <= yysize1 && yysize1 <= YYSTACK_ALLOC_MAXIMUM))
-      return 2;
-    yysize = yysize1;
-  }
 
-  if (*yymsg_alloc < yysize)
-    {
-      *yymsg_alloc = 2 * yysize;
-      if (! (yysize <= *yymsg_alloc
-             && *yymsg_alloc <= YYSTACK_ALLOC_MAXIMUM))
-        *yymsg_alloc = YYSTACK_ALLOC_MAXIMUM;
-      return 1;
-    }
 
-  /* Avoid sprintf, as that infringes on the user's name space.
-     Don't have undefined behavior even if the translation
-     produced a string with the wrong number of "%s"s.  */
-  {
-    char *yyp = *yymsg;
-    int yyi = 0;
-    while ((*yyp = *yyformat) != '\0')
-      if (*yyp == '%' && yyformat[1] == 's' && yyi < yycount)
-        {
-          yyp += yytnamerr (yyp, yyarg[yyi++]);
-          yyformat += 2;
-        }
-      else
-        {
-          yyp++;
-          yyformat++;
-        }
-  }
-  return 0;
-}
-#endif /* YYERROR_VERBOSE */
 
 /*-----------------------------------------------.
 | Release the memory associated to this symbol.  |
 `-----------------------------------------------*/
 
 static void
-yydestruct (const char *yymsg, int yytype, YYSTYPE *yyvaluep, CommandHolder** __ret_cmds)
+yydestruct (const char *yymsg,
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep, CommandHolder** __ret_cmds)
 {
-  YYUSE (yyvaluep);
-  YYUSE (__ret_cmds);
+  YY_USE (yyvaluep);
+  YY_USE (__ret_cmds);
   if (!yymsg)
     yymsg = "Deleting";
-  YY_SYMBOL_PRINT (yymsg, yytype, yyvaluep, yylocationp);
+  YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
 
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
-  YYUSE (yytype);
+  YY_USE (yykind);
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 }
 
 
-
-
-/* The lookahead symbol.  */
+/* Lookahead token kind.  */
 int yychar;
 
 /* The semantic value of the lookahead symbol.  */
@@ -1057,6 +911,8 @@ YYSTYPE yylval;
 int yynerrs;
 
 
+
+
 /*----------.
 | yyparse.  |
 `----------*/
@@ -1064,43 +920,36 @@ int yynerrs;
 int
 yyparse (CommandHolder** __ret_cmds)
 {
-    int yystate;
+    yy_state_fast_t yystate = 0;
     /* Number of tokens to shift before error messages enabled.  */
-    int yyerrstatus;
+    int yyerrstatus = 0;
 
-    /* The stacks and their tools:
-       'yyss': related to states.
-       'yyvs': related to semantic values.
-
-       Refer to the stacks through separate pointers, to allow yyoverflow
+    /* Refer to the stacks through separate pointers, to allow yyoverflow
        to reallocate them elsewhere.  */
 
-    /* The state stack.  */
-    yytype_int16 yyssa[YYINITDEPTH];
-    yytype_int16 *yyss;
-    yytype_int16 *yyssp;
+    /* Their size.  */
+    YYPTRDIFF_T yystacksize = YYINITDEPTH;
 
-    /* The semantic value stack.  */
-    YYSTYPE yyvsa[YYINITDEPTH];
-    YYSTYPE *yyvs;
-    YYSTYPE *yyvsp;
+    /* The state stack: array, bottom, top.  */
+    yy_state_t yyssa[YYINITDEPTH];
+    yy_state_t *yyss = yyssa;
+    yy_state_t *yyssp = yyss;
 
-    YYSIZE_T yystacksize;
+    /* The semantic value stack: array, bottom, top.  */
+    YYSTYPE yyvsa[YYINITDEPTH];
+    YYSTYPE *yyvs = yyvsa;
+    YYSTYPE *yyvsp = yyvs;
 
   int yyn;
+  /* The return value of yyparse.  */
   int yyresult;
-  /* Lookahead token as an internal (translated) token number.  */
-  int yytoken = 0;
+  /* Lookahead symbol kind.  */
+  yysymbol_kind_t yytoken = YYSYMBOL_YYEMPTY;
   /* The variables used to return semantic value and location from the
      action routines.  */
   YYSTYPE yyval;
 
-#if YYERROR_VERBOSE
-  /* Buffer for error messages, and its allocated size.  */
-  char yymsgbuf[128];
-  char *yymsg = yymsgbuf;
-  YYSIZE_T yymsg_alloc = sizeof yymsgbuf;
-#endif
+
 
 #define YYPOPSTACK(N)   (yyvsp -= (N), yyssp -= (N))
 
@@ -1108,71 +957,75 @@ yyparse (CommandHolder** __ret_cmds)
      Keep to zero when no symbol should be popped.  */
   int yylen = 0;
 
-  yyssp = yyss = yyssa;
-  yyvsp = yyvs = yyvsa;
-  yystacksize = YYINITDEPTH;
-
   YYDPRINTF ((stderr, "Starting parse\n"));
 
-  yystate = 0;
-  yyerrstatus = 0;
-  yynerrs = 0;
   yychar = YYEMPTY; /* Cause a token to be read.  */
+
   goto yysetstate;
 
+
 /*------------------------------------------------------------.
-| yynewstate -- Push a new state, which is found in yystate.  |
+| yynewstate -- push a new state, which is found in yystate.  |
 `------------------------------------------------------------*/
- yynewstate:
+yynewstate:
   /* In all cases, when you get here, the value and location stacks
      have just been pushed.  So pushing a state here evens the stacks.  */
   yyssp++;
 
- yysetstate:
-  *yyssp = yystate;
+
+/*--------------------------------------------------------------------.
+| yysetstate -- set current state (the top of the stack) to yystate.  |
+`--------------------------------------------------------------------*/
+yysetstate:
+  YYDPRINTF ((stderr, "Entering state %d\n", yystate));
+  YY_ASSERT (0 <= yystate && yystate < YYNSTATES);
+  YY_IGNORE_USELESS_CAST_BEGIN
+  *yyssp = YY_CAST (yy_state_t, yystate);
+  YY_IGNORE_USELESS_CAST_END
+  YY_STACK_PRINT (yyss, yyssp);
 
   if (yyss + yystacksize - 1 <= yyssp)
+#if !defined yyoverflow && !defined YYSTACK_RELOCATE
+    YYNOMEM;
+#else
     {
       /* Get the current used size of the three stacks, in elements.  */
-      YYSIZE_T yysize = yyssp - yyss + 1;
+      YYPTRDIFF_T yysize = yyssp - yyss + 1;
 
-#ifdef yyoverflow
+# if defined yyoverflow
       {
         /* Give user a chance to reallocate the stack.  Use copies of
            these so that the &'s don't force the real ones into
            memory.  */
+        yy_state_t *yyss1 = yyss;
         YYSTYPE *yyvs1 = yyvs;
-        yytype_int16 *yyss1 = yyss;
 
         /* Each stack pointer address is followed by the size of the
            data in use in that stack, in bytes.  This used to be a
            conditional around just the two extra args, but that might
            be undefined if yyoverflow is a macro.  */
         yyoverflow (YY_("memory exhausted"),
-                    &yyss1, yysize * sizeof (*yyssp),
-                    &yyvs1, yysize * sizeof (*yyvsp),
+                    &yyss1, yysize * YYSIZEOF (*yyssp),
+                    &yyvs1, yysize * YYSIZEOF (*yyvsp),
                     &yystacksize);
-
         yyss = yyss1;
         yyvs = yyvs1;
       }
-#else /* no yyoverflow */
-# ifndef YYSTACK_RELOCATE
-      goto yyexhaustedlab;
-# else
+# else /* defined YYSTACK_RELOCATE */
       /* Extend the stack our own way.  */
       if (YYMAXDEPTH <= yystacksize)
-        goto yyexhaustedlab;
+        YYNOMEM;
       yystacksize *= 2;
       if (YYMAXDEPTH < yystacksize)
         yystacksize = YYMAXDEPTH;
 
       {
-        yytype_int16 *yyss1 = yyss;
+        yy_state_t *yyss1 = yyss;
         union yyalloc *yyptr =
-          (union yyalloc *) YYSTACK_ALLOC (YYSTACK_BYTES (yystacksize));
+          YY_CAST (union yyalloc *,
+                   YYSTACK_ALLOC (YY_CAST (YYSIZE_T, YYSTACK_BYTES (yystacksize))));
         if (! yyptr)
-          goto yyexhaustedlab;
+          YYNOMEM;
         YYSTACK_RELOCATE (yyss_alloc, yyss);
         YYSTACK_RELOCATE (yyvs_alloc, yyvs);
 #  undef YYSTACK_RELOCATE
@@ -1180,30 +1033,31 @@ yyparse (CommandHolder** __ret_cmds)
           YYSTACK_FREE (yyss1);
       }
 # endif
-#endif /* no yyoverflow */
 
       yyssp = yyss + yysize - 1;
       yyvsp = yyvs + yysize - 1;
 
-      YYDPRINTF ((stderr, "Stack size increased to %lu\n",
-                  (unsigned long int) yystacksize));
+      YY_IGNORE_USELESS_CAST_BEGIN
+      YYDPRINTF ((stderr, "Stack size increased to %ld\n",
+                  YY_CAST (long, yystacksize)));
+      YY_IGNORE_USELESS_CAST_END
 
       if (yyss + yystacksize - 1 <= yyssp)
         YYABORT;
     }
+#endif /* !defined yyoverflow && !defined YYSTACK_RELOCATE */
 
-  YYDPRINTF ((stderr, "Entering state %d\n", yystate));
 
   if (yystate == YYFINAL)
     YYACCEPT;
 
   goto yybackup;
 
+
 /*-----------.
 | yybackup.  |
 `-----------*/
 yybackup:
-
   /* Do appropriate processing given the current state.  Read a
      lookahead token if we need one and don't already have one.  */
 
@@ -1214,18 +1068,29 @@ yybackup:
 
   /* Not known => get a lookahead token if don't already have one.  */
 
-  /* YYCHAR is either YYEMPTY or YYEOF or a valid lookahead symbol.  */
+  /* YYCHAR is either empty, or end-of-input, or a valid lookahead.  */
   if (yychar == YYEMPTY)
     {
-      YYDPRINTF ((stderr, "Reading a token: "));
+      YYDPRINTF ((stderr, "Reading a token\n"));
       yychar = yylex ();
     }
 
   if (yychar <= YYEOF)
     {
-      yychar = yytoken = YYEOF;
+      yychar = YYEOF;
+      yytoken = YYSYMBOL_YYEOF;
       YYDPRINTF ((stderr, "Now at end of input.\n"));
     }
+  else if (yychar == YYerror)
+    {
+      /* The scanner already issued an error message, process directly
+         to error recovery.  But do not keep the error token as
+         lookahead, it is too special and may lead us to an endless
+         loop in error recovery. */
+      yychar = YYUNDEF;
+      yytoken = YYSYMBOL_YYerror;
+      goto yyerrlab1;
+    }
   else
     {
       yytoken = YYTRANSLATE (yychar);
@@ -1253,15 +1118,13 @@ yybackup:
 
   /* Shift the lookahead token.  */
   YY_SYMBOL_PRINT ("Shifting", yytoken, &yylval, &yylloc);
-
-  /* Discard the shifted token.  */
-  yychar = YYEMPTY;
-
   yystate = yyn;
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
   *++yyvsp = yylval;
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 
+  /* Discard the shifted token.  */
+  yychar = YYEMPTY;
   goto yynewstate;
 
 
@@ -1276,7 +1139,7 @@ yydefault:
 
 
 /*-----------------------------.
-| yyreduce -- Do a reduction.  |
+| yyreduce -- do a reduction.  |
 `-----------------------------*/
 yyreduce:
   /* yyn is the number of a rule to reduce with.  */
@@ -1296,31 +1159,45 @@ yyreduce:
   YY_REDUCE_PRINT (yyn);
   switch (yyn)
     {
-        case 2:
-#line 64 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 2: /* top: EOC_TOK  */
+#line 69 "src/parsing/parse.y"
+                {
   *__ret_cmds = NULL;
 
   YYACCEPT;
 }
-#line 1307 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1170 "src/parsing/parse.tab.c"
     break;
 
-  case 3:
-#line 69 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 3: /* top: END  */
+#line 74 "src/parsing/parse.y"
+            {
+  *__ret_cmds = NULL;
+
+  end_main_loop(EXIT_SUCCESS);
+
+  YYACCEPT;
+}
+#line 1182 "src/parsing/parse.tab.c"
+    break;
+
+  case 4: /* top: job EOC_TOK  */
+#line 81 "src/parsing/parse.y"
+                    {
+  mark_timed_job(&(yyvsp[-1].cmd_list));
   push_back_Cmds(&(yyvsp[-1].cmd_list), mk_command_holder(NULL, NULL, 0, mk_eoc()));
 
   *__ret_cmds = as_array_Cmds(&(yyvsp[-1].cmd_list), NULL);
 
   YYACCEPT;
 }
-#line 1319 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1195 "src/parsing/parse.tab.c"
     break;
 
-  case 4:
-#line 76 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 5: /* top: job END  */
+#line 89 "src/parsing/parse.y"
+                {
+  mark_timed_job(&(yyvsp[-1].cmd_list));
   push_back_Cmds(&(yyvsp[-1].cmd_list), mk_command_holder(NULL, NULL, 0, mk_eoc()));
 
   *__ret_cmds = as_array_Cmds(&(yyvsp[-1].cmd_list), NULL);
@@ -1329,46 +1206,87 @@ yyreduce:
 
   YYACCEPT;
 }
-#line 1333 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1210 "src/parsing/parse.tab.c"
     break;
 
-  case 5:
-#line 85 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 6: /* top: error EOC_TOK  */
+#line 99 "src/parsing/parse.y"
+                      {
   *__ret_cmds = NULL;
 
   YYABORT;
 }
-#line 1343 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1220 "src/parsing/parse.tab.c"
     break;
 
-  case 6:
-#line 90 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 7: /* top: error END  */
+#line 104 "src/parsing/parse.y"
+                  {
   *__ret_cmds = NULL;
 
   end_main_loop(EXIT_FAILURE);
 
   YYABORT;
 }
-#line 1355 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1232 "src/parsing/parse.tab.c"
     break;
 
-  case 7:
-#line 100 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 8: /* job: cmds  */
+#line 114 "src/parsing/parse.y"
+             {
+  (yyval.cmd_list) = (yyvsp[0].cmd_list);
+}
+#line 1240 "src/parsing/parse.tab.c"
+    break;
+
+  case 9: /* job: assignment  */
+#line 117 "src/parsing/parse.y"
+                   {
   Cmds cs = new_Cmds(1);
 
   push_front_Cmds(&cs, (yyvsp[0].holder));
 
   (yyval.cmd_list) = cs;
 }
-#line 1367 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1252 "src/parsing/parse.tab.c"
     break;
 
-  case 8:
-#line 107 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 10: /* job: assignment job  */
+#line 124 "src/parsing/parse.y"
+                       {
+  // Assignments in front of a job run with it in the background
+  (yyvsp[-1].holder).flags |= peek_front_Cmds(&(yyvsp[0].cmd_list)).flags & BACKGROUND;
+
+  push_front_Cmds(&(yyvsp[0].cmd_list), (yyvsp[-1].holder));
+
+  (yyval.cmd_list) = (yyvsp[0].cmd_list);
+}
+#line 1265 "src/parsing/parse.tab.c"
+    break;
+
+  case 11: /* assignment: ID EQUALS string  */
+#line 135 "src/parsing/parse.y"
+                             {
+  (yyval.holder) = mk_command_holder(NULL, NULL, 0, mk_assign_command((yyvsp[-2].str), (yyvsp[0].str)));
+}
+#line 1273 "src/parsing/parse.tab.c"
+    break;
+
+  case 12: /* cmds: cmd_top  */
+#line 141 "src/parsing/parse.y"
+                {
+  Cmds cs = new_Cmds(1);
+
+  push_front_Cmds(&cs, (yyvsp[0].holder));
+
+  (yyval.cmd_list) = cs;
+}
+#line 1285 "src/parsing/parse.tab.c"
+    break;
+
+  case 13: /* cmds: cmd_top PIPE cmds  */
+#line 148 "src/parsing/parse.y"
+                          {
   CommandHolder prev = pop_front_Cmds(&(yyvsp[0].cmd_list));
 
   (yyvsp[-2].holder).flags = ((yyvsp[-2].holder).flags & ~(REDIRECT_APPEND | REDIRECT_OUT)) | PIPE_OUT;
@@ -1382,12 +1300,12 @@ yyreduce:
 
   (yyval.cmd_list) = (yyvsp[0].cmd_list);
 }
-#line 1386 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1304 "src/parsing/parse.tab.c"
     break;
 
-  case 9:
-#line 124 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 14: /* cmd_top: cmd_content redir cmd_bg  */
+#line 165 "src/parsing/parse.y"
+                                  {
   char flags = (((yyvsp[-1].redirect).append)? REDIRECT_APPEND : 0) |
     (((yyvsp[-1].redirect).out)? REDIRECT_OUT : 0) |
     (((yyvsp[-1].redirect).in)? REDIRECT_IN : 0) |
@@ -1395,118 +1313,130 @@ yyreduce:
 
   (yyval.holder) = mk_command_holder((yyvsp[-1].redirect).in, (yyvsp[-1].redirect).out, flags, (yyvsp[-2].cmd));
 }
-#line 1399 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1317 "src/parsing/parse.tab.c"
     break;
 
-  case 10:
-#line 135 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
-  (yyval.cmd) = mk_generic_command(as_array_CmdStrs(&(yyvsp[0].cmd_strs), NULL));
+  case 15: /* cmd_content: cmd  */
+#line 176 "src/parsing/parse.y"
+                 {
+  (yyval.cmd) = mk_command_from_args(as_array_CmdStrs(&(yyvsp[0].cmd_strs), NULL));
 }
-#line 1407 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1325 "src/parsing/parse.tab.c"
     break;
 
-  case 11:
-#line 138 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 16: /* cmd_content: ECHO_TOK  */
+#line 179 "src/parsing/parse.y"
+                 {
   char** cmd = memory_pool_alloc(sizeof(char*));
   *cmd = NULL;
   (yyval.cmd) = mk_echo_command(cmd);
 }
-#line 1417 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1335 "src/parsing/parse.tab.c"
     break;
 
-  case 12:
-#line 143 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 17: /* cmd_content: ECHO_TOK cmd_arguments  */
+#line 184 "src/parsing/parse.y"
+                               {
   (yyval.cmd) = mk_echo_command(as_array_CmdStrs(&(yyvsp[0].cmd_strs), NULL));
 }
-#line 1425 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1343 "src/parsing/parse.tab.c"
     break;
 
-  case 13:
-#line 146 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 18: /* cmd_content: EXPORT_TOK ID EQUALS string  */
+#line 187 "src/parsing/parse.y"
+                                    {
   (yyval.cmd) = mk_export_command((yyvsp[-2].str), (yyvsp[0].str));
 }
-#line 1433 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1351 "src/parsing/parse.tab.c"
     break;
 
-  case 14:
-#line 149 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
-  (yyval.cmd) = mk_cd_command(memory_pool_strdup(lookup_env("HOME")));
+  case 19: /* cmd_content: EXPORT_TOK ID  */
+#line 190 "src/parsing/parse.y"
+                      {
+  (yyval.cmd) = mk_export_command((yyvsp[0].str), NULL);
 }
-#line 1441 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1359 "src/parsing/parse.tab.c"
     break;
 
-  case 15:
-#line 152 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
-  char* resolved_path;
-  char* ret = NULL;
-
-  if ((resolved_path = realpath((yyvsp[0].str), NULL)) != NULL) {
-    ret = memory_pool_strdup(resolved_path);
-    free(resolved_path);
-  }
+  case 20: /* cmd_content: CD_TOK  */
+#line 193 "src/parsing/parse.y"
+               {
+  // HOME is looked up when cd runs, after any export in front of it
+  (yyval.cmd) = mk_cd_command(NULL);
+}
+#line 1368 "src/parsing/parse.tab.c"
+    break;
 
-  (yyval.cmd) = mk_cd_command(ret);
+  case 21: /* cmd_content: CD_TOK string  */
+#line 197 "src/parsing/parse.y"
+                      {
+  // The path is resolved when cd runs, in case it is created in between
+  (yyval.cmd) = mk_cd_command((yyvsp[0].str));
 }
-#line 1457 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1377 "src/parsing/parse.tab.c"
     break;
 
-  case 16:
-#line 163 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 22: /* cmd_content: PWD_TOK  */
+#line 201 "src/parsing/parse.y"
+                {
   (yyval.cmd) = mk_pwd_command();
 }
-#line 1465 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1385 "src/parsing/parse.tab.c"
     break;
 
-  case 17:
-#line 166 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
-  (yyval.cmd) = mk_jobs_command();
+  case 23: /* cmd_content: JOBS_TOK  */
+#line 204 "src/parsing/parse.y"
+                 {
+  char** args = memory_pool_alloc(sizeof(char*));
+  *args = NULL;
+  (yyval.cmd) = mk_jobs_command(args);
 }
-#line 1473 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1395 "src/parsing/parse.tab.c"
     break;
 
-  case 18:
-#line 169 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 24: /* cmd_content: JOBS_TOK cmd_arguments  */
+#line 209 "src/parsing/parse.y"
+                               {
+  (yyval.cmd) = mk_jobs_command(as_array_CmdStrs(&(yyvsp[0].cmd_strs), NULL));
+}
+#line 1403 "src/parsing/parse.tab.c"
+    break;
+
+  case 25: /* cmd_content: EXIT_TOK  */
+#line 212 "src/parsing/parse.y"
+                 {
   (yyval.cmd) = mk_exit_command();
 }
-#line 1481 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1411 "src/parsing/parse.tab.c"
     break;
 
-  case 19:
-#line 172 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 26: /* cmd_content: KILL_TOK NUM NUM  */
+#line 215 "src/parsing/parse.y"
+                         {
   (yyval.cmd) = mk_kill_command((yyvsp[-1].str), (yyvsp[0].str));
 }
-#line 1489 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1419 "src/parsing/parse.tab.c"
     break;
 
-  case 20:
-#line 176 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 27: /* redir: redir_inner  */
+#line 219 "src/parsing/parse.y"
+                   {
   (yyval.redirect) = (yyvsp[0].redirect);
 }
-#line 1497 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1427 "src/parsing/parse.tab.c"
     break;
 
-  case 21:
-#line 179 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 28: /* redir: %empty  */
+#line 222 "src/parsing/parse.y"
+       {
   (yyval.redirect) = mk_redirect(NULL, NULL, false);
 }
-#line 1505 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1435 "src/parsing/parse.tab.c"
     break;
 
-  case 22:
-#line 185 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 29: /* redir_inner: redir_mark string redir_inner  */
+#line 228 "src/parsing/parse.y"
+                                           {
   if ((yyvsp[-2].integer) == REDIRECT_IN) {
     (yyvsp[0].redirect).in = (yyvsp[-1].str);
   }
@@ -1521,12 +1451,12 @@ yyreduce:
 
   (yyval.redirect) = (yyvsp[0].redirect);
 }
-#line 1525 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1455 "src/parsing/parse.tab.c"
     break;
 
-  case 23:
-#line 200 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 30: /* redir_inner: redir_mark string  */
+#line 243 "src/parsing/parse.y"
+                          {
   Redirect r;
 
   if ((yyvsp[-1].integer) == REDIRECT_IN)
@@ -1540,62 +1470,62 @@ yyreduce:
 
   (yyval.redirect) = r;
 }
-#line 1544 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1474 "src/parsing/parse.tab.c"
     break;
 
-  case 24:
-#line 217 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 31: /* redir_mark: REDIRIN  */
+#line 260 "src/parsing/parse.y"
+                    {
   (yyval.integer) = REDIRECT_IN;
 }
-#line 1552 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1482 "src/parsing/parse.tab.c"
     break;
 
-  case 25:
-#line 220 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 32: /* redir_mark: REDIROUT  */
+#line 263 "src/parsing/parse.y"
+                 {
   (yyval.integer) = REDIRECT_OUT;
 }
-#line 1560 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1490 "src/parsing/parse.tab.c"
     break;
 
-  case 26:
-#line 223 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 33: /* redir_mark: REDIROUTAPP  */
+#line 266 "src/parsing/parse.y"
+                    {
   (yyval.integer) = REDIRECT_APPEND;
 }
-#line 1568 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1498 "src/parsing/parse.tab.c"
     break;
 
-  case 27:
-#line 229 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 34: /* cmd_bg: %empty  */
+#line 272 "src/parsing/parse.y"
+        {
   (yyval.integer) = 0;
 }
-#line 1576 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1506 "src/parsing/parse.tab.c"
     break;
 
-  case 28:
-#line 232 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 35: /* cmd_bg: BCKGRND  */
+#line 275 "src/parsing/parse.y"
+                {
   (yyval.integer) = 1;
 }
-#line 1584 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1514 "src/parsing/parse.tab.c"
     break;
 
-  case 29:
-#line 238 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 36: /* cmd: first_string cmd_arguments  */
+#line 281 "src/parsing/parse.y"
+                                   {
   push_front_CmdStrs(&(yyvsp[0].cmd_strs), (yyvsp[-1].str));
 
   (yyval.cmd_strs) = (yyvsp[0].cmd_strs);
 }
-#line 1594 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1524 "src/parsing/parse.tab.c"
     break;
 
-  case 30:
-#line 243 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 37: /* cmd: first_string  */
+#line 286 "src/parsing/parse.y"
+                     {
   CmdStrs args = new_CmdStrs(1);
 
   push_front_CmdStrs(&args, (yyvsp[0].str));
@@ -1603,12 +1533,12 @@ yyreduce:
 
   (yyval.cmd_strs) = args;
 }
-#line 1607 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1537 "src/parsing/parse.tab.c"
     break;
 
-  case 31:
-#line 254 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 38: /* cmd_arguments: string  */
+#line 297 "src/parsing/parse.y"
+                      {
   CmdStrs args = new_CmdStrs(1);
 
   push_front_CmdStrs(&args, (yyvsp[0].str));
@@ -1616,125 +1546,126 @@ yyreduce:
 
   (yyval.cmd_strs) = args;
 }
-#line 1620 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1550 "src/parsing/parse.tab.c"
     break;
 
-  case 32:
-#line 262 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 39: /* cmd_arguments: string cmd_arguments  */
+#line 305 "src/parsing/parse.y"
+                             {
   push_front_CmdStrs(&(yyvsp[0].cmd_strs), (yyvsp[-1].str));
 
   (yyval.cmd_strs) = (yyvsp[0].cmd_strs);
 }
-#line 1630 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1560 "src/parsing/parse.tab.c"
     break;
 
-  case 33:
-#line 270 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 40: /* string: first_string  */
+#line 313 "src/parsing/parse.y"
+                     {
   (yyval.str) = (yyvsp[0].str);
 }
-#line 1638 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1568 "src/parsing/parse.tab.c"
     break;
 
-  case 34:
-#line 273 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 41: /* string: special_string  */
+#line 316 "src/parsing/parse.y"
+                       {
   (yyval.str) = (yyvsp[0].str);
 }
-#line 1646 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1576 "src/parsing/parse.tab.c"
     break;
 
-  case 35:
-#line 277 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 42: /* special_string: ECHO_TOK  */
+#line 320 "src/parsing/parse.y"
+                         {
   (yyval.str) = memory_pool_strdup("echo");
 }
-#line 1654 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1584 "src/parsing/parse.tab.c"
     break;
 
-  case 36:
-#line 280 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 43: /* special_string: EXPORT_TOK  */
+#line 323 "src/parsing/parse.y"
+                   {
   (yyval.str) = memory_pool_strdup("export");
 }
-#line 1662 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1592 "src/parsing/parse.tab.c"
     break;
 
-  case 37:
-#line 283 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 44: /* special_string: CD_TOK  */
+#line 326 "src/parsing/parse.y"
+               {
   (yyval.str) = memory_pool_strdup("cd");
 }
-#line 1670 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1600 "src/parsing/parse.tab.c"
     break;
 
-  case 38:
-#line 286 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 45: /* special_string: KILL_TOK  */
+#line 329 "src/parsing/parse.y"
+                 {
   (yyval.str) = memory_pool_strdup("kill");
 }
-#line 1678 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1608 "src/parsing/parse.tab.c"
     break;
 
-  case 39:
-#line 289 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 46: /* special_string: PWD_TOK  */
+#line 332 "src/parsing/parse.y"
+                {
   (yyval.str) = memory_pool_strdup("pwd");
 }
-#line 1686 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1616 "src/parsing/parse.tab.c"
     break;
 
-  case 40:
-#line 292 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 47: /* special_string: JOBS_TOK  */
+#line 335 "src/parsing/parse.y"
+                 {
   (yyval.str) = memory_pool_strdup("jobs");
 }
-#line 1694 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1624 "src/parsing/parse.tab.c"
     break;
 
-  case 41:
-#line 295 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 48: /* special_string: EXIT_TOK  */
+#line 338 "src/parsing/parse.y"
+                 {
   (yyval.str) = (yyvsp[0].str);
 }
-#line 1702 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1632 "src/parsing/parse.tab.c"
     break;
 
-  case 42:
-#line 299 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
-  (yyval.str) = interpret_complex_string_token((yyvsp[0].str));
+  case 49: /* first_string: STR  */
+#line 342 "src/parsing/parse.y"
+                  {
+  (yyval.str) = read_string_token((yyvsp[0].str));
 }
-#line 1710 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1640 "src/parsing/parse.tab.c"
     break;
 
-  case 43:
-#line 302 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 50: /* first_string: SIM_STR  */
+#line 345 "src/parsing/parse.y"
+                {
   (yyval.str) = (yyvsp[0].str);
 }
-#line 1718 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1648 "src/parsing/parse.tab.c"
     break;
 
-  case 44:
-#line 305 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 51: /* first_string: NUM  */
+#line 348 "src/parsing/parse.y"
+            {
   (yyval.str) = (yyvsp[0].str);
 }
-#line 1726 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1656 "src/parsing/parse.tab.c"
     break;
 
-  case 45:
-#line 308 "src/parsing/parse.y" /* yacc.c:1646  */
-    {
+  case 52: /* first_string: ID  */
+#line 351 "src/parsing/parse.y"
+           {
   (yyval.str) = (yyvsp[0].str);
 }
-#line 1734 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1664 "src/parsing/parse.tab.c"
     break;
 
 
-#line 1738 "src/parsing/parse.tab.c" /* yacc.c:1646  */
+#line 1668 "src/parsing/parse.tab.c"
+
       default: break;
     }
   /* User semantic actions sometimes alter yychar, and that requires
@@ -1748,25 +1679,23 @@ yyreduce:
      case of YYERROR or YYBACKUP, subsequent parser actions might lead
      to an incorrect destructor call or verbose syntax error message
      before the lookahead is translated.  */
-  YY_SYMBOL_PRINT ("-> $$ =", yyr1[yyn], &yyval, &yyloc);
+  YY_SYMBOL_PRINT ("-> $$ =", YY_CAST (yysymbol_kind_t, yyr1[yyn]), &yyval, &yyloc);
 
   YYPOPSTACK (yylen);
   yylen = 0;
-  YY_STACK_PRINT (yyss, yyssp);
 
   *++yyvsp = yyval;
 
   /* Now 'shift' the result of the reduction.  Determine what state
      that goes to, based on the state we popped back to and the rule
      number reduced by.  */
-
-  yyn = yyr1[yyn];
-
-  yystate = yypgoto[yyn - YYNTOKENS] + *yyssp;
-  if (0 <= yystate && yystate <= YYLAST && yycheck[yystate] == *yyssp)
-    yystate = yytable[yystate];
-  else
-    yystate = yydefgoto[yyn - YYNTOKENS];
+  {
+    const int yylhs = yyr1[yyn] - YYNTOKENS;
+    const int yyi = yypgoto[yylhs] + *yyssp;
+    yystate = (0 <= yyi && yyi <= YYLAST && yycheck[yyi] == *yyssp
+               ? yytable[yyi]
+               : yydefgoto[yylhs]);
+  }
 
   goto yynewstate;
 
@@ -1777,50 +1706,14 @@ yyreduce:
 yyerrlab:
   /* Make sure we have latest lookahead translation.  See comments at
      user semantic actions for why this is necessary.  */
-  yytoken = yychar == YYEMPTY ? YYEMPTY : YYTRANSLATE (yychar);
-
+  yytoken = yychar == YYEMPTY ? YYSYMBOL_YYEMPTY : YYTRANSLATE (yychar);
   /* If not already recovering from an error, report this error.  */
   if (!yyerrstatus)
     {
       ++yynerrs;
-#if ! YYERROR_VERBOSE
       yyerror (__ret_cmds, YY_("syntax error"));
-#else
-# define YYSYNTAX_ERROR yysyntax_error (&yymsg_alloc, &yymsg, \
-                                        yyssp, yytoken)
-      {
-        char const *yymsgp = YY_("syntax error");
-        int yysyntax_error_status;
-        yysyntax_error_status = YYSYNTAX_ERROR;
-        if (yysyntax_error_status == 0)
-          yymsgp = yymsg;
-        else if (yysyntax_error_status == 1)
-          {
-            if (yymsg != yymsgbuf)
-              YYSTACK_FREE (yymsg);
-            yymsg = (char *) YYSTACK_ALLOC (yymsg_alloc);
-            if (!yymsg)
-              {
-                yymsg = yymsgbuf;
-                yymsg_alloc = sizeof yymsgbuf;
-                yysyntax_error_status = 2;
-              }
-            else
-              {
-                yysyntax_error_status = YYSYNTAX_ERROR;
-                yymsgp = yymsg;
-              }
-          }
-        yyerror (__ret_cmds, yymsgp);
-        if (yysyntax_error_status == 2)
-          goto yyexhaustedlab;
-      }
-# undef YYSYNTAX_ERROR
-#endif
     }
 
-
-
   if (yyerrstatus == 3)
     {
       /* If just tried and failed to reuse lookahead token after an
@@ -1849,12 +1742,11 @@ yyerrlab:
 | yyerrorlab -- error raised explicitly by YYERROR.  |
 `---------------------------------------------------*/
 yyerrorlab:
-
-  /* Pacify compilers like GCC when the user code never invokes
-     YYERROR and the label yyerrorlab therefore never appears in user
-     code.  */
-  if (/*CONSTCOND*/ 0)
-     goto yyerrorlab;
+  /* Pacify compilers when the user code never invokes YYERROR and the
+     label yyerrorlab therefore never appears in user code.  */
+  if (0)
+    YYERROR;
+  ++yynerrs;
 
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYERROR.  */
@@ -1871,13 +1763,14 @@ yyerrorlab:
 yyerrlab1:
   yyerrstatus = 3;      /* Each real token shifted decrements this.  */
 
+  /* Pop stack until we find a state that shifts the error token.  */
   for (;;)
     {
       yyn = yypact[yystate];
       if (!yypact_value_is_default (yyn))
         {
-          yyn += YYTERROR;
-          if (0 <= yyn && yyn <= YYLAST && yycheck[yyn] == YYTERROR)
+          yyn += YYSYMBOL_YYerror;
+          if (0 <= yyn && yyn <= YYLAST && yycheck[yyn] == YYSYMBOL_YYerror)
             {
               yyn = yytable[yyn];
               if (0 < yyn)
@@ -1891,7 +1784,7 @@ yyerrlab1:
 
 
       yydestruct ("Error: popping",
-                  yystos[yystate], yyvsp, __ret_cmds);
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp, __ret_cmds);
       YYPOPSTACK (1);
       yystate = *yyssp;
       YY_STACK_PRINT (yyss, yyssp);
@@ -1903,7 +1796,7 @@ yyerrlab1:
 
 
   /* Shift the error token.  */
-  YY_SYMBOL_PRINT ("Shifting", yystos[yyn], yyvsp, yylsp);
+  YY_SYMBOL_PRINT ("Shifting", YY_ACCESSING_SYMBOL (yyn), yyvsp, yylsp);
 
   yystate = yyn;
   goto yynewstate;
@@ -1914,26 +1807,30 @@ yyerrlab1:
 `-------------------------------------*/
 yyacceptlab:
   yyresult = 0;
-  goto yyreturn;
+  goto yyreturnlab;
+
 
 /*-----------------------------------.
 | yyabortlab -- YYABORT comes here.  |
 `-----------------------------------*/
 yyabortlab:
   yyresult = 1;
-  goto yyreturn;
+  goto yyreturnlab;
 
-#if !defined yyoverflow || YYERROR_VERBOSE
-/*-------------------------------------------------.
-| yyexhaustedlab -- memory exhaustion comes here.  |
-`-------------------------------------------------*/
+
+/*-----------------------------------------------------------.
+| yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
+`-----------------------------------------------------------*/
 yyexhaustedlab:
   yyerror (__ret_cmds, YY_("memory exhausted"));
   yyresult = 2;
-  /* Fall through.  */
-#endif
+  goto yyreturnlab;
 
-yyreturn:
+
+/*----------------------------------------------------------.
+| yyreturnlab -- parsing is finished, clean up and return.  |
+`----------------------------------------------------------*/
+yyreturnlab:
   if (yychar != YYEMPTY)
     {
       /* Make sure we have latest lookahead translation.  See comments at
@@ -1949,22 +1846,61 @@ yyreturn:
   while (yyssp != yyss)
     {
       yydestruct ("Cleanup: popping",
-                  yystos[*yyssp], yyvsp, __ret_cmds);
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp, __ret_cmds);
       YYPOPSTACK (1);
     }
 #ifndef yyoverflow
   if (yyss != yyssa)
     YYSTACK_FREE (yyss);
 #endif
-#if YYERROR_VERBOSE
-  if (yymsg != yymsgbuf)
-    YYSTACK_FREE (yymsg);
-#endif
+
   return yyresult;
 }
-#line 312 "src/parsing/parse.y" /* yacc.c:1906  */
 
+#line 355 "src/parsing/parse.y"
+
+
+// `time` reaches the parser as an ordinary word, so a job whose first command
+// is `time` followed by a command is turned into a timed job running that
+// command
+static void mark_timed_job(Cmds* cmds) {
+  CommandHolder first = peek_front_Cmds(cmds);
+
+  if (get_command_holder_type(first) != GENERIC)
+    return;
+
+  char** args = first.cmd.generic.args;
+
+  if (strcmp(args[0], "time") != 0 || args[1] == NULL)
+    return;
+
+  // Builtins the lexer gives their own token were read as plain words here.
+  // cd, export and kill need their arguments parsed, so they run as programs.
+  if (strcmp(args[1], "echo") == 0)
+    first.cmd = mk_echo_command(args + 2);
+  else if (strcmp(args[1], "pwd") == 0)
+    first.cmd = mk_pwd_command();
+  else if (strcmp(args[1], "jobs") == 0)
+    first.cmd = mk_jobs_command(args + 2);
+  else
+    first.cmd = mk_command_from_args(args + 1);
+
+  update_front_Cmds(cmds, first);
+
+  // Rotate through the whole pipeline so every stage carries the flag
+  for (size_t n = length_Cmds(cmds); n > 0; --n) {
+    CommandHolder holder = pop_front_Cmds(cmds);
+
+    holder.flags |= TIMED;
+    push_back_Cmds(cmds, holder);
+  }
+}
 
 void yyerror(CommandHolder** cmds, char *str) {
+  syntax_error_seen = true;
   fprintf(stderr, "%s: Line %d\n", str, yylineno);
 }
+
+bool had_syntax_error() {
+  return syntax_error_seen;
+}
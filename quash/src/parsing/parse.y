@@ -16,7 +16,12 @@ extern void yyerror(CommandHolder**, char*);
 extern int yyparse(CommandHolder**);
 extern int yylex();
 
+static void mark_timed_job(Cmds* cmds);
+
 int yyerrstatus = 0;
+
+// Set once any line of the input fails to parse
+static bool syntax_error_seen = false;
 %}
 
 %code requires {
@@ -50,10 +55,10 @@ int yyerrstatus = 0;
 %type <str> string first_string special_string
 %type <integer> cmd_bg redir_mark
 %type <redirect> redir redir_inner
-%type <holder> cmd_top
+%type <holder> cmd_top assignment
 %type <cmd> cmd_content
 %type <cmd_strs> cmd cmd_arguments
-%type <cmd_list> cmds
+%type <cmd_list> cmds job
 %type <cmd_arr> top
 
 /* Start symbol */
@@ -66,14 +71,23 @@ top:    EOC_TOK {
 
   YYACCEPT;
 }
-|       cmds EOC_TOK {
+|       END {
+  *__ret_cmds = NULL;
+
+  end_main_loop(EXIT_SUCCESS);
+
+  YYACCEPT;
+}
+|       job EOC_TOK {
+  mark_timed_job(&$1);
   push_back_Cmds(&$1, mk_command_holder(NULL, NULL, 0, mk_eoc()));
 
   *__ret_cmds = as_array_Cmds(&$1, NULL);
 
   YYACCEPT;
 }
-|       cmds END {
+|       job END {
+  mark_timed_job(&$1);
   push_back_Cmds(&$1, mk_command_holder(NULL, NULL, 0, mk_eoc()));
 
   *__ret_cmds = as_array_Cmds(&$1, NULL);
@@ -97,6 +111,33 @@ top:    EOC_TOK {
 
 
 
+job:    cmds {
+  $$ = $1;
+}
+|       assignment {
+  Cmds cs = new_Cmds(1);
+
+  push_front_Cmds(&cs, $1);
+
+  $$ = cs;
+}
+|       assignment job {
+  // Assignments in front of a job run with it in the background
+  $1.flags |= peek_front_Cmds(&$2).flags & BACKGROUND;
+
+  push_front_Cmds(&$2, $1);
+
+  $$ = $2;
+}
+
+
+
+assignment: ID EQUALS string {
+  $$ = mk_command_holder(NULL, NULL, 0, mk_assign_command($1, $3));
+}
+
+
+
 cmds:   cmd_top {
   Cmds cs = new_Cmds(1);
 
@@ -133,7 +174,7 @@ cmd_top: cmd_content redir cmd_bg {
 
 
 cmd_content: cmd {
-  $$ = mk_generic_command(as_array_CmdStrs(&$1, NULL));
+  $$ = mk_command_from_args(as_array_CmdStrs(&$1, NULL));
 }
 |       ECHO_TOK {
   char** cmd = memory_pool_alloc(sizeof(char*));
@@ -146,25 +187,27 @@ cmd_content: cmd {
 |       EXPORT_TOK ID EQUALS string {
   $$ = mk_export_command($2, $4);
 }
+|       EXPORT_TOK ID {
+  $$ = mk_export_command($2, NULL);
+}
 |       CD_TOK {
-  $$ = mk_cd_command(memory_pool_strdup(lookup_env("HOME")));
+  // HOME is looked up when cd runs, after any export in front of it
+  $$ = mk_cd_command(NULL);
 }
 |       CD_TOK string {
-  char* resolved_path;
-  char* ret = NULL;
-
-  if ((resolved_path = realpath($2, NULL)) != NULL) {
-    ret = memory_pool_strdup(resolved_path);
-    free(resolved_path);
-  }
-
-  $$ = mk_cd_command(ret);
+  // The path is resolved when cd runs, in case it is created in between
+  $$ = mk_cd_command($2);
 }
 |       PWD_TOK {
   $$ = mk_pwd_command();
 }
 |       JOBS_TOK {
-  $$ = mk_jobs_command();
+  char** args = memory_pool_alloc(sizeof(char*));
+  *args = NULL;
+  $$ = mk_jobs_command(args);
+}
+|       JOBS_TOK cmd_arguments {
+  $$ = mk_jobs_command(as_array_CmdStrs(&$2, NULL));
 }
 |       EXIT_TOK {
   $$ = mk_exit_command();
@@ -297,7 +340,7 @@ special_string: ECHO_TOK {
 }
 
 first_string: STR {
-  $$ = interpret_complex_string_token($1);
+  $$ = read_string_token($1);
 }
 |       SIM_STR {
   $$ = $1;
@@ -311,6 +354,47 @@ first_string: STR {
 
 %%
 
+// `time` reaches the parser as an ordinary word, so a job whose first command
+// is `time` followed by a command is turned into a timed job running that
+// command
+static void mark_timed_job(Cmds* cmds) {
+  CommandHolder first = peek_front_Cmds(cmds);
+
+  if (get_command_holder_type(first) != GENERIC)
+    return;
+
+  char** args = first.cmd.generic.args;
+
+  if (strcmp(args[0], "time") != 0 || args[1] == NULL)
+    return;
+
+  // Builtins the lexer gives their own token were read as plain words here.
+  // cd, export and kill need their arguments parsed, so they run as programs.
+  if (strcmp(args[1], "echo") == 0)
+    first.cmd = mk_echo_command(args + 2);
+  else if (strcmp(args[1], "pwd") == 0)
+    first.cmd = mk_pwd_command();
+  else if (strcmp(args[1], "jobs") == 0)
+    first.cmd = mk_jobs_command(args + 2);
+  else
+    first.cmd = mk_command_from_args(args + 1);
+
+  update_front_Cmds(cmds, first);
+
+  // Rotate through the whole pipeline so every stage carries the flag
+  for (size_t n = length_Cmds(cmds); n > 0; --n) {
+    CommandHolder holder = pop_front_Cmds(cmds);
+
+    holder.flags |= TIMED;
+    push_back_Cmds(cmds, holder);
+  }
+}
+
 void yyerror(CommandHolder** cmds, char *str) {
+  syntax_error_seen = true;
   fprintf(stderr, "%s: Line %d\n", str, yylineno);
 }
+
+bool had_syntax_error() {
+  return syntax_error_seen;
+}
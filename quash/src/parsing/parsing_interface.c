@@ -2,22 +2,30 @@
 
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "memory_pool.h"
 #include "parse.tab.h"
 
 IMPLEMENT_DEQUE_STRUCT(SizeStack, size_t);
-IMPLEMENT_DEQUE_STRUCT(StrBuilder, char);
 IMPLEMENT_DEQUE_STRUCT(MPStrBuilder, char);
+IMPLEMENT_DEQUE_STRUCT(Scripts, CommandHolder*);
 
 IMPLEMENT_DEQUE(SizeStack, size_t);
-IMPLEMENT_DEQUE(StrBuilder, char);
 IMPLEMENT_DEQUE_MEMORY_POOL(MPStrBuilder, char);
 IMPLEMENT_DEQUE_MEMORY_POOL(CmdStrs, char*);
 IMPLEMENT_DEQUE_MEMORY_POOL(Cmds, CommandHolder);
+IMPLEMENT_DEQUE_MEMORY_POOL(Scripts, CommandHolder*);
 
 extern void destroy_lex();
+extern struct yy_buffer_state* yy_scan_buffer(char* base, size_t size);
+extern struct yy_buffer_state* yy_scan_string(const char* str);
+extern void scan_stream_by_line(FILE* stream);
+
+// Set while parse_all() reads jobs that run later, so that their variables are
+// expanded by expand_script() when they run rather than when they are read
+static bool defer_expansion = false;
 
 // Generate a string based off of a pipable generic command
 static inline void __stringify_generic_cmd(GenericCommand cmd, CmdStrs* strs) {
@@ -26,25 +34,39 @@ static inline void __stringify_generic_cmd(GenericCommand cmd, CmdStrs* strs) {
     push_back_CmdStrs(strs, cmd.args[i]);
 }
 
-static inline void __stringify_echo_cmd(EchoCommand cmd, CmdStrs* strs) {
-  push_back_CmdStrs(strs, memory_pool_strdup("echo"));
+// Generate a string based off of a builtin that only holds its arguments
+static inline void __stringify_named_cmd(const char* name, char** args, CmdStrs* strs) {
+  push_back_CmdStrs(strs, memory_pool_strdup(name));
 
   // Extract argument strings
-  for (size_t i = 0; cmd.args[i] != NULL; ++i)
-    push_back_CmdStrs(strs, cmd.args[i]);
+  for (size_t i = 0; args[i] != NULL; ++i)
+    push_back_CmdStrs(strs, args[i]);
 }
 
 // Generate a string based off the export command
 static void __stringify_export_cmd(ExportCommand cmd, CmdStrs* strs) {
   push_back_CmdStrs(strs, memory_pool_strdup("export"));
   push_back_CmdStrs(strs, cmd.env_var);
-  push_back_CmdStrs(strs, cmd.val);
+
+  if (cmd.val != NULL)
+    push_back_CmdStrs(strs, cmd.val);
+}
+
+// Generate a string based off of a variable assignment
+static void __stringify_assign_cmd(AssignCommand cmd, CmdStrs* strs) {
+  size_t len = strlen(cmd.env_var) + strlen(cmd.val) + 2;
+  char* str = memory_pool_alloc(len);
+
+  snprintf(str, len, "%s=%s", cmd.env_var, cmd.val);
+  push_back_CmdStrs(strs, str);
 }
 
 // Generate a string based off of the cd command
 static void __stringify_cd_cmd(CDCommand cmd, CmdStrs* strs) {
   push_back_CmdStrs(strs, memory_pool_strdup("cd"));
-  push_back_CmdStrs(strs, cmd.dir);
+
+  if (cmd.dir != NULL)
+    push_back_CmdStrs(strs, cmd.dir);
 }
 
 // Generate a string based off of the kill command
@@ -67,7 +89,7 @@ static void __stringify_command(Command cmd, CmdStrs* strs) {
     break;
 
   case ECHO:
-    __stringify_echo_cmd(cmd.echo, strs);
+    __stringify_named_cmd("echo", cmd.echo.args, strs);
     break;
 
   case EXPORT:
@@ -86,15 +108,17 @@ static void __stringify_command(Command cmd, CmdStrs* strs) {
     __stringify_simple_cmd("PWD", strs);
     break;
 
-  case JOBS:
-    __stringify_simple_cmd("JOBS", strs);
-    break;
-
   case EXIT:
     __stringify_simple_cmd("EXIT", strs);
     break;
 
+  case ASSIGN:
+    __stringify_assign_cmd(cmd.assign, strs);
+    break;
+
   default:
+    if (get_named_builtin(cmd) != NULL)
+      __stringify_named_cmd(get_named_builtin(cmd), cmd.generic.args, strs);
     break;
   }
 }
@@ -127,6 +151,9 @@ static void __stringify_script(const CommandHolder* holders, CmdStrs* strs) {
   assert(strs != NULL);
 
   if (holders != NULL) {
+    if (holders[0].flags & TIMED)
+      push_back_CmdStrs(strs, memory_pool_strdup("time"));
+
     for (size_t i = 0; get_command_holder_type(holders[i]) != EOC; ++i)
       __stringify_holder(holders[i], strs);
 
@@ -186,26 +213,20 @@ static void __interpret_deref(MPStrBuilder* bld, const char* str, int* idx) {
   // Remove the dereference symbol at the back of the bld deque
   pop_back_MPStrBuilder(bld);
 
-  StrBuilder tmp = new_StrBuilder(16);
-  char c;
-
-  // Extract the identifier characters. Since this is intended only as a helper
+  // Measure the identifier in place. Since this is intended only as a helper
   // function we assume that interpret_complex_string token has already noticed
   // a valid first identifier character after the dereference symbol.
-  while (__is_identifier_char((c = str[++(*idx)])))
-    push_back_StrBuilder(&tmp, c);
-
-  // idx increments one too far in the while loop so bring it back down
-  --(*idx);
+  const char* id = str + *idx + 1;
+  size_t len = 0;
 
-  // Add the null terminator to the string
-  push_back_StrBuilder(&tmp, '\0');
+  while (__is_identifier_char(id[len]))
+    ++len;
 
-  // Extract the id string and lookup the environment variable
-  char* id = as_array_StrBuilder(&tmp, NULL);
-  const char* env_var = lookup_env(id);
+  // Leave idx on the last character of the identifier
+  *idx += len;
 
-  free(id);
+  // The table looks the name up without copying it out of the token
+  const char* env_var = lookup_n_env(id, len);
 
   // Append env_var to the string builder
   if (env_var != NULL) {
@@ -214,6 +235,33 @@ static void __interpret_deref(MPStrBuilder* bld, const char* str, int* idx) {
   }
 }
 
+// Expand $0 to $9 to the positional parameters
+static void __interpret_positional(MPStrBuilder* bld, const char* str, int* idx) {
+  // Replace the dereference symbol and skip the digit
+  pop_back_MPStrBuilder(bld);
+
+  const char* param = get_positional_parameter(str[++(*idx)] - '0');
+
+  if (param != NULL) {
+    for (int i = 0; param[i] != '\0'; ++i)
+      push_back_MPStrBuilder(bld, param[i]);
+  }
+}
+
+// Expand $? to the exit status of the last foreground job
+static void __interpret_status(MPStrBuilder* bld, int* idx) {
+  char status[16];
+
+  // Replace the dereference symbol and skip the '?'
+  pop_back_MPStrBuilder(bld);
+  ++(*idx);
+
+  snprintf(status, sizeof(status), "%d", get_last_exit_status());
+
+  for (int i = 0; status[i] != '\0'; ++i)
+    push_back_MPStrBuilder(bld, status[i]);
+}
+
 // Cleans up escapes and unescaped single quotes and expands environment
 // variables found in a string
 char* interpret_complex_string_token(const char* str) {
@@ -267,6 +315,10 @@ char* interpret_complex_string_token(const char* str) {
     case '$':                 // Try to dereference environment variables
       if (!in_quotes && __is_first_identifier_char(str[i + 1]))
         __interpret_deref(&bld, str, &i);
+      else if (!in_quotes && str[i + 1] == '?')
+        __interpret_status(&bld, &i);
+      else if (!in_quotes && isdigit((unsigned char) str[i + 1]))
+        __interpret_positional(&bld, str, &i);
       break;
 
     default:
@@ -282,6 +334,71 @@ char* interpret_complex_string_token(const char* str) {
   return as_array_MPStrBuilder(&bld, NULL);
 }
 
+// Expand a string token as it is read, unless the job runs later
+char* read_string_token(char* str) {
+  return defer_expansion ? str : interpret_complex_string_token(str);
+}
+
+// Expand a string that may be missing. Most words have nothing to expand and
+// are kept as they are.
+static char* __expand_string(char* str) {
+  if (str == NULL || strpbrk(str, "$'\\") == NULL)
+    return str;
+
+  return interpret_complex_string_token(str);
+}
+
+// Expand a NULL terminated array of strings in place
+static void __expand_strings(char** strs) {
+  for (size_t i = 0; strs[i] != NULL; ++i)
+    strs[i] = __expand_string(strs[i]);
+}
+
+// Expand the strings of a script read by parse_all()
+void expand_script(CommandHolder* holders) {
+  assert(holders != NULL);
+
+  for (size_t i = 0; get_command_holder_type(holders[i]) != EOC; ++i) {
+    CommandHolder* holder = &holders[i];
+
+    holder->redirect_in = __expand_string(holder->redirect_in);
+    holder->redirect_out = __expand_string(holder->redirect_out);
+
+    switch (get_command_holder_type(*holder)) {
+    case GENERIC:
+      __expand_strings(holder->cmd.generic.args);
+
+      // The name of the command may only now turn out to be a builtin
+      holder->cmd = mk_command_from_args(holder->cmd.generic.args);
+      break;
+
+    case ECHO:
+    case JOBS:
+    case HASH:
+    case WAIT:
+    case TIMEOUT:
+    case AFTER:
+    case PARALLEL:
+    case JOBLOG:
+    case JOBPRIO:
+      __expand_strings(holder->cmd.generic.args);
+      break;
+
+    case EXPORT:
+    case ASSIGN:
+      holder->cmd.export.val = __expand_string(holder->cmd.export.val);
+      break;
+
+    case CD:
+      holder->cmd.cd.dir = __expand_string(holder->cmd.cd.dir);
+      break;
+
+    default:
+      break;
+    }
+  }
+}
+
 // Build a Redirect structure
 Redirect mk_redirect(char* in, char* out, bool append) {
   return (Redirect) {
@@ -298,14 +415,70 @@ CommandHolder* parse(QuashState* state) {
   CommandHolder* holders;
 
   yyparse(&holders);
+  state->parsed_str = NULL;
 
-  if (holders != NULL) {
-    CmdStrs strs = new_CmdStrs(10);
-    __stringify_script(holders, &strs);
-    state->parsed_str = __condense_string_array(as_array_CmdStrs(&strs, NULL));
+  return holders;
+}
+
+// Check if a script is exit or quit on its own
+static bool __is_exit_script(const CommandHolder* holders) {
+  return get_command_holder_type(holders[0]) == EXIT &&
+    get_command_holder_type(holders[1]) == EOC;
+}
+
+// Parse the rest of the input
+CommandHolder** parse_all(QuashState* state) {
+  assert(state != NULL);
+
+  Scripts scripts = new_Scripts(64);
+
+  defer_expansion = true;
+
+  while (is_running()) {
+    CommandHolder* holders;
+
+    yyparse(&holders);
+
+    if (holders == NULL)
+      continue;
+
+    push_back_Scripts(&scripts, holders);
+
+    // Nothing after exit runs, so it is not read either
+    if (__is_exit_script(holders))
+      break;
   }
 
-  return holders;
+  defer_expansion = false;
+  state->parsed_str = NULL;
+
+  push_back_Scripts(&scripts, NULL);
+
+  return as_array_Scripts(&scripts, NULL);
+}
+
+// Build the string of a script for job listings
+char* stringify_script(const CommandHolder* holders) {
+  CmdStrs strs = new_CmdStrs(10);
+
+  __stringify_script(holders, &strs);
+
+  return __condense_string_array(as_array_CmdStrs(&strs, NULL));
+}
+
+// Scan commands in place from a buffer ending with two NUL bytes
+bool parse_buffer(char* buf, size_t size) {
+  return yy_scan_buffer(buf, size) != NULL;
+}
+
+// Scan commands from a copy of a string
+void parse_string(const char* str) {
+  yy_scan_string(str);
+}
+
+// Scan commands from a stream a line at a time
+void parse_stream(FILE* stream) {
+  scan_stream_by_line(stream);
 }
 
 // Clean up dynamically allocated memory in the parser
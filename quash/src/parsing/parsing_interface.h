@@ -9,6 +9,7 @@
 #define SRC_PARSING_PARSING_INTERFACE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "command.h"
 #include "deque.h"
@@ -82,16 +83,38 @@ Redirect mk_redirect(char* in, char* out, bool append);
  */
 char* interpret_complex_string_token(const char* str);
 
+/**
+ * @brief Interpret a string token read by the parser with
+ * interpret_complex_string_token(), or keep it as written while parse_all()
+ * is reading jobs that expand_script() expands later
+ *
+ * @param str The string token allocated on the @a MemoryPool
+ *
+ * @return The string to store in the command
+ */
+char* read_string_token(char* str);
+
+/**
+ * @brief Expand the variables and quotes of a script read by parse_all()
+ *
+ * Each job must be expanded right before it runs so that it sees the
+ * variables, working directory and exit status left by the jobs before it,
+ * just like a job parsed on its own.
+ *
+ * @param holders The script to expand in place
+ */
+void expand_script(CommandHolder* holders);
+
 
 /*************************************************************
  * Functions used by the parser
  *************************************************************/
 /**
- * @brief Handles the call to the parser and provides a string equivalent of the
- * @a Command structure to @a QuashState
+ * @brief Handles the call to the parser for a single job
  *
  * @param[out] state The state of the quash shell. The parsed_str member of
- * QuashState is set to the stringified command structure.
+ * QuashState is cleared, it is only filled in with stringify_script() for the
+ * jobs whose string is shown.
  *
  * @return A pointer to the parsed command structure
  *
@@ -99,6 +122,71 @@ char* interpret_complex_string_token(const char* str);
  */
 CommandHolder* parse(QuashState* state);
 
+/**
+ * @brief Parse every job left in the input before any of them runs
+ *
+ * Reading stops at the end of the input or after a job that is only exit or
+ * quit. Lines with a syntax error are reported and left out. The strings of
+ * the jobs are not expanded yet, see expand_script().
+ *
+ * @param[out] state The state of the quash shell
+ *
+ * @return A NULL terminated array of the scripts allocated on the @a
+ * MemoryPool
+ *
+ * @sa parse(), expand_script()
+ */
+CommandHolder** parse_all(QuashState* state);
+
+/**
+ * @brief Check if any of the input read so far had a syntax error
+ *
+ * @return True once the parser has reported a syntax error
+ */
+bool had_syntax_error();
+
+/**
+ * @brief Build the string of a script shown in job listings
+ *
+ * @param holders The script
+ *
+ * @return The string allocated on the @a MemoryPool
+ */
+char* stringify_script(const CommandHolder* holders);
+
+/**
+ * @brief Make the parser read commands from memory instead of standard in
+ *
+ * The scanner works on the buffer in place and may write to it, so it must
+ * stay valid and writable until the parser is destroyed.
+ *
+ * @param buf The commands followed by two NUL bytes
+ *
+ * @param size Size of @a buf including the two NUL bytes
+ *
+ * @return False if @a buf does not end with two NUL bytes
+ */
+bool parse_buffer(char* buf, size_t size);
+
+/**
+ * @brief Make the parser read commands from a copy of a string instead of
+ * standard in
+ *
+ * @param str The commands
+ */
+void parse_string(const char* str);
+
+/**
+ * @brief Make the parser read commands from a stream instead of standard in
+ *
+ * The stream is read a line at a time like a terminal is, so the parser never
+ * waits for more input than the job it returns. Must be called before anything
+ * is parsed.
+ *
+ * @param stream The stream, which stays owned by the caller
+ */
+void parse_stream(FILE* stream);
+
 /**
  * @brief Cleanup memory dynamically allocated by the parser
  */
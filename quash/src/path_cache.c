@@ -0,0 +1,181 @@
+/**
+ * @file path_cache.c
+ *
+ * @brief Implements the command path cache
+ */
+
+#include "path_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "execute.h"
+#include "hash_table.h"
+
+static HashTable cache = { NULL, 0, 0 };
+
+// Last path found through a relative PATH entry, which is never cached
+static char* uncached_path = NULL;
+
+// Lazily create the table the first time it is needed
+static HashTable* __cache() {
+  if (cache.buckets == NULL)
+    init_hash_table(&cache, 64);
+
+  return &cache;
+}
+
+// Check if a path names a regular file we are allowed to execute
+static bool __is_executable(const char* path) {
+  struct stat st;
+
+  return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+// Walk the PATH environment variable looking for name. Returns a malloc'd path
+// or NULL if nothing was found. relative is set if the result depends on the
+// working directory: the path was found through a relative entry, or nothing
+// was found and a relative entry was searched.
+static char* __search_path(const char* name, bool* relative) {
+  const char* path = lookup_env("PATH");
+
+  *relative = false;
+
+  if (path == NULL)
+    return NULL;
+
+  size_t name_len = strlen(name);
+
+  for (const char* dir = path; ; ) {
+    const char* end = strchr(dir, ':');
+    size_t dir_len = (end != NULL) ? (size_t) (end - dir) : strlen(dir);
+
+    // An empty entry means the current directory
+    const char* prefix = (dir_len == 0) ? "." : dir;
+    size_t prefix_len = (dir_len == 0) ? 1 : dir_len;
+
+    char* candidate = malloc(prefix_len + name_len + 2);
+    memcpy(candidate, prefix, prefix_len);
+    candidate[prefix_len] = '/';
+    memcpy(candidate + prefix_len + 1, name, name_len + 1);
+
+    *relative = *relative || prefix[0] != '/';
+
+    if (__is_executable(candidate)) {
+      *relative = prefix[0] != '/';
+      return candidate;
+    }
+
+    free(candidate);
+
+    if (end == NULL)
+      return NULL;
+
+    dir = end + 1;
+  }
+}
+
+const char* resolve_command_path(const char* name) {
+  if (strchr(name, '/') != NULL)
+    return name;
+
+  HashEntry* e = lookup_hash_table(__cache(), name);
+
+  if (e == NULL) {
+    bool relative;
+    char* found = __search_path(name, &relative);
+
+    // The same name may lead elsewhere after cd, so the result is not kept
+    if (relative) {
+      free(uncached_path);
+      uncached_path = found;
+
+      return found;
+    }
+
+    e = insert_hash_table(__cache(), name, found);
+    free(found);
+  }
+
+  if (e->value != NULL)
+    e->count++;
+
+  return e->value;
+}
+
+const char* rehash_command_path(const char* name) {
+  if (strchr(name, '/') != NULL)
+    return NULL;
+
+  forget_cached_path(name);
+
+  return resolve_command_path(name);
+}
+
+bool hash_command(const char* name) {
+  if (strchr(name, '/') != NULL)
+    return __is_executable(name);
+
+  bool relative;
+  char* found = __search_path(name, &relative);
+  bool ok = found != NULL;
+
+  if (!relative)
+    insert_hash_table(__cache(), name, found);
+
+  free(found);
+
+  return ok;
+}
+
+void set_cached_path(const char* name, const char* path) {
+  HashEntry* e = insert_hash_table(__cache(), name, path);
+
+  e->count = 0;
+}
+
+bool forget_cached_path(const char* name) {
+  return remove_hash_table(__cache(), name);
+}
+
+const char* get_cached_path(const char* name) {
+  HashEntry* e = lookup_hash_table(__cache(), name);
+
+  return (e != NULL) ? e->value : NULL;
+}
+
+static void __print_entry(HashEntry* e) {
+  if (e->value != NULL)
+    printf("%4d\t%s\n", e->count, e->value);
+}
+
+void print_path_cache() {
+  bool any = false;
+
+  for (size_t i = 0; i < cache.cap && !any; ++i) {
+    for (HashEntry* e = cache.buckets[i]; e != NULL && !any; e = e->next)
+      any = e->value != NULL;
+  }
+
+  if (!any) {
+    printf("hash: hash table empty\n");
+    return;
+  }
+
+  printf("hits\tcommand\n");
+  apply_hash_table(&cache, __print_entry);
+}
+
+void clear_path_cache() {
+  if (cache.buckets != NULL)
+    empty_hash_table(&cache);
+}
+
+void destroy_path_cache() {
+  destroy_hash_table(&cache);
+
+  free(uncached_path);
+  uncached_path = NULL;
+}
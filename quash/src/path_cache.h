@@ -0,0 +1,102 @@
+/**
+ * @file path_cache.h
+ *
+ * @brief Remembers where commands were found in the PATH environment variable
+ *
+ * Resolving a command by walking every PATH entry costs a failing system call
+ * per directory. The cache keeps the resolved absolute path, or the fact that
+ * nothing was found, keyed by command name so later launches can hand the
+ * path straight to exec.
+ */
+
+#ifndef SRC_PATH_CACHE_H
+#define SRC_PATH_CACHE_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Find the executable a command name refers to
+ *
+ * Names containing a '/' are returned unchanged. Otherwise the cache is
+ * consulted and the PATH environment variable is only searched on a miss.
+ * Both hits and misses of the search are cached, except for results that
+ * depend on the working directory: hits found through a relative PATH entry
+ * such as "." and misses of a PATH with such an entry.
+ *
+ * @param name The command name (the first argument of a command)
+ *
+ * @return The path to execute or NULL if the command could not be found. The
+ * string is owned by the cache and is valid until the cache next changes.
+ */
+const char* resolve_command_path(const char* name);
+
+/**
+ * @brief Forget what is cached for a command name and search PATH again
+ *
+ * Used when the cached path could not be executed because it no longer
+ * exists.
+ *
+ * @param name The command name
+ *
+ * @return The new path, or NULL if the command could not be found or @a name
+ * contains a '/' so there is nothing to search for. The string is owned by the
+ * cache like the one returned by resolve_command_path().
+ */
+const char* rehash_command_path(const char* name);
+
+/**
+ * @brief Search PATH for a command and store the result in the cache
+ *
+ * @param name The command name to look up
+ *
+ * @return True if the command was found
+ */
+bool hash_command(const char* name);
+
+/**
+ * @brief Store a path in the cache for a command name without searching PATH
+ *
+ * @param name The command name
+ *
+ * @param path The path to use for @a name
+ */
+void set_cached_path(const char* name, const char* path);
+
+/**
+ * @brief Remove a command name from the cache
+ *
+ * @param name The command name to forget
+ *
+ * @return True if @a name was in the cache
+ */
+bool forget_cached_path(const char* name);
+
+/**
+ * @brief Get the path cached for a command name
+ *
+ * @param name The command name
+ *
+ * @return The cached path or NULL if @a name is not cached or is cached as not
+ * found
+ */
+const char* get_cached_path(const char* name);
+
+/**
+ * @brief Print every command found in the cache with the number of times it
+ * has been used
+ */
+void print_path_cache();
+
+/**
+ * @brief Forget every cached command
+ *
+ * Called whenever PATH changes since every cached result may now be wrong.
+ */
+void clear_path_cache();
+
+/**
+ * @brief Free the memory held by the cache
+ */
+void destroy_path_cache();
+
+#endif
@@ -0,0 +1,211 @@
+/**
+ * @file priority.c
+ *
+ * @brief Implements the priority of the processes of jobs
+ */
+
+// SCHED_BATCH and SCHED_IDLE
+#define _GNU_SOURCE
+
+#include "priority.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "execute.h"
+
+// The C library has no wrapper for ioprio_set(2). These match
+// <linux/ioprio.h>.
+#define IOPRIO_CLASS_NONE (0)
+#define IOPRIO_CLASS_RT (1)
+#define IOPRIO_CLASS_BE (2)
+#define IOPRIO_CLASS_IDLE (3)
+#define IOPRIO_CLASS_SHIFT (13)
+#define IOPRIO_WHO_PROCESS (1)
+#define IOPRIO_MAX_LEVEL (7)
+
+static const struct {
+  const char* name;
+  int value;
+} policies[] = {
+  { "other", SCHED_OTHER },
+  { "batch", SCHED_BATCH },
+  { "idle", SCHED_IDLE },
+};
+
+static const struct {
+  const char* name;
+  int value;
+} ioclasses[] = {
+  { "none", IOPRIO_CLASS_NONE },
+  { "rt", IOPRIO_CLASS_RT },
+  { "be", IOPRIO_CLASS_BE },
+  { "idle", IOPRIO_CLASS_IDLE },
+};
+
+#define NUM_ENTRIES(a) (sizeof(a) / sizeof(a[0]))
+
+// Parse an integer in a range. Returns false if the string is not one.
+static bool __parse_int(const char* str, int min, int max, int* value) {
+  char* end;
+  long n = strtol(str, &end, 10);
+
+  if (end == str || *end != '\0' || n < min || n > max)
+    return false;
+
+  *value = n;
+  return true;
+}
+
+static bool __parse_ioclass(const char* str, JobPriority* prio) {
+  const char* colon = strchr(str, ':');
+  size_t len = (colon != NULL) ? (size_t) (colon - str) : strlen(str);
+  int level = 4; // The default level of the best effort class
+
+  if (colon != NULL && !__parse_int(colon + 1, 0, IOPRIO_MAX_LEVEL, &level))
+    return false;
+
+  for (size_t i = 0; i < NUM_ENTRIES(ioclasses); ++i) {
+    if (strlen(ioclasses[i].name) == len && strncmp(str, ioclasses[i].name, len) == 0) {
+      // Only the realtime and best effort classes have levels
+      if (colon != NULL && ioclasses[i].value != IOPRIO_CLASS_RT &&
+          ioclasses[i].value != IOPRIO_CLASS_BE)
+        return false;
+
+      prio->ioclass = ioclasses[i].value;
+      prio->iolevel = level;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void clear_priority(JobPriority* prio) {
+  prio->nice = PRIORITY_UNSET;
+  prio->policy = PRIORITY_UNSET;
+  prio->ioclass = PRIORITY_UNSET;
+  prio->iolevel = 0;
+}
+
+bool has_priority(const JobPriority* prio) {
+  return prio->nice != PRIORITY_UNSET || prio->policy != PRIORITY_UNSET ||
+    prio->ioclass != PRIORITY_UNSET;
+}
+
+bool set_priority_field(JobPriority* prio, char opt, const char* value) {
+  switch (opt) {
+  case 'n':
+    return __parse_int(value, -20, 19, &prio->nice);
+
+  case 's':
+    for (size_t i = 0; i < NUM_ENTRIES(policies); ++i) {
+      if (strcmp(value, policies[i].name) == 0) {
+        prio->policy = policies[i].value;
+        return true;
+      }
+    }
+
+    return false;
+
+  case 'i':
+    return __parse_ioclass(value, prio);
+
+  default:
+    return false;
+  }
+}
+
+void inherit_background_priority(JobPriority* prio) {
+  static const struct {
+    const char* var;
+    char opt;
+  } vars[] = {
+    { "QUASH_BG_NICE", 'n' },
+    { "QUASH_BG_SCHED", 's' },
+    { "QUASH_BG_IOCLASS", 'i' },
+  };
+
+  JobPriority env;
+  clear_priority(&env);
+
+  for (size_t i = 0; i < NUM_ENTRIES(vars); ++i) {
+    const char* value = lookup_env(vars[i].var);
+
+    if (value != NULL && *value != '\0' && !set_priority_field(&env, vars[i].opt, value))
+      fprintf(stderr, "ERROR: Invalid %s %s\n", vars[i].var, value);
+  }
+
+  if (prio->nice == PRIORITY_UNSET)
+    prio->nice = env.nice;
+
+  if (prio->policy == PRIORITY_UNSET)
+    prio->policy = env.policy;
+
+  if (prio->ioclass == PRIORITY_UNSET) {
+    prio->ioclass = env.ioclass;
+    prio->iolevel = env.iolevel;
+  }
+}
+
+bool apply_priority(const JobPriority* prio, pid_t pid) {
+  bool ok = true;
+
+  if (prio->policy != PRIORITY_UNSET) {
+    struct sched_param param = { .sched_priority = 0 };
+
+    if (sched_setscheduler(pid, prio->policy, &param) == -1) {
+      fprintf(stderr, "ERROR: Failed to set the scheduling policy of %d. Error #%d\n", pid, errno);
+      ok = false;
+    }
+  }
+
+  if (prio->nice != PRIORITY_UNSET && setpriority(PRIO_PROCESS, pid, prio->nice) == -1) {
+    fprintf(stderr, "ERROR: Failed to set the nice value of %d. Error #%d\n", pid, errno);
+    ok = false;
+  }
+
+  if (prio->ioclass != PRIORITY_UNSET) {
+    int value = (prio->ioclass << IOPRIO_CLASS_SHIFT) | prio->iolevel;
+
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, pid, value) == -1) {
+      fprintf(stderr, "ERROR: Failed to set the I/O priority of %d. Error #%d\n", pid, errno);
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+void format_priority(const JobPriority* prio, char* buf, size_t len) {
+  size_t used = 0;
+
+  buf[0] = '\0';
+
+  if (prio->nice != PRIORITY_UNSET)
+    used += snprintf(buf + used, len - used, "nice %d", prio->nice);
+
+  for (size_t i = 0; i < NUM_ENTRIES(policies) && used < len; ++i) {
+    if (prio->policy == policies[i].value)
+      used += snprintf(buf + used, len - used, "%s%s", (used > 0) ? " " : "", policies[i].name);
+  }
+
+  for (size_t i = 0; i < NUM_ENTRIES(ioclasses) && used < len; ++i) {
+    if (prio->ioclass != ioclasses[i].value)
+      continue;
+
+    used += snprintf(buf + used, len - used, "%sio %s", (used > 0) ? " " : "", ioclasses[i].name);
+
+    if (used < len && (prio->ioclass == IOPRIO_CLASS_RT || prio->ioclass == IOPRIO_CLASS_BE))
+      used += snprintf(buf + used, len - used, ":%d", prio->iolevel);
+  }
+
+  if (used == 0)
+    snprintf(buf, len, "default");
+}
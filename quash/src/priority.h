@@ -0,0 +1,100 @@
+/**
+ * @file priority.h
+ *
+ * @brief The CPU and I/O priority background jobs run at
+ *
+ * Background jobs are launched with the priority set by QUASH_BG_NICE (a nice
+ * value), QUASH_BG_SCHED (other, batch or idle) and QUASH_BG_IOCLASS (none,
+ * idle, be or rt, optionally followed by ":LEVEL") so they do not compete with
+ * the commands typed at the prompt. Foreground jobs keep the priority of
+ * quash.
+ */
+
+#ifndef SRC_PRIORITY_H
+#define SRC_PRIORITY_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @brief Value of a @a JobPriority field that leaves the priority alone
+ */
+#define PRIORITY_UNSET (INT_MIN)
+
+/**
+ * @brief The priority of the processes of a job
+ */
+typedef struct JobPriority {
+  int nice;    /**< Nice value or PRIORITY_UNSET */
+  int policy;  /**< Scheduling policy like SCHED_BATCH or PRIORITY_UNSET */
+  int ioclass; /**< I/O scheduling class or PRIORITY_UNSET */
+  int iolevel; /**< Level within @a ioclass, from 0 (highest) to 7 */
+} JobPriority;
+
+/**
+ * @brief Set every field of a priority to PRIORITY_UNSET
+ *
+ * @param prio The priority to clear
+ */
+void clear_priority(JobPriority* prio);
+
+/**
+ * @brief Check if any field of a priority is set
+ *
+ * @param prio The priority
+ *
+ * @return True if applying @a prio changes anything
+ */
+bool has_priority(const JobPriority* prio);
+
+/**
+ * @brief Set one field of a priority from its textual form
+ *
+ * @param prio The priority to change
+ *
+ * @param opt 'n' for the nice value, 's' for the scheduling policy or 'i' for
+ * the I/O class
+ *
+ * @param value The value, like "10", "batch" or "be:7"
+ *
+ * @return False if @a value is invalid
+ */
+bool set_priority_field(JobPriority* prio, char opt, const char* value);
+
+/**
+ * @brief Fill the fields of a priority that are not set from QUASH_BG_NICE,
+ * QUASH_BG_SCHED and QUASH_BG_IOCLASS
+ *
+ * Invalid variables are reported and ignored.
+ *
+ * @param prio The priority of a background job
+ */
+void inherit_background_priority(JobPriority* prio);
+
+/**
+ * @brief Give a process a priority
+ *
+ * Errors are reported and the remaining fields are still applied.
+ *
+ * @param prio The priority
+ *
+ * @param pid The process or 0 for the calling process
+ *
+ * @return True if every field was applied
+ */
+bool apply_priority(const JobPriority* prio, pid_t pid);
+
+/**
+ * @brief Describe a priority, like "nice 10 batch io idle"
+ *
+ * @param prio The priority
+ *
+ * @param buf Buffer receiving the description
+ *
+ * @param len Size of @a buf
+ */
+void format_priority(const JobPriority* prio, char* buf, size_t len);
+
+#endif
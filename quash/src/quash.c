@@ -7,55 +7,266 @@
 /**************************************************************************
  * Included Files
  **************************************************************************/
+// fopencookie()
+#define _GNU_SOURCE
+
 #include "quash.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <stdio.h>
 
 #include "command.h"
 #include "parsing_interface.h"
+#include "jobs.h"
 #include "memory_pool.h"
+#include "path_cache.h"
+#include "variables.h"
 
 /**************************************************************************
  * Private Variables
  **************************************************************************/
 static QuashState state;
 
+// The script file the parser scans in place, if quash runs one
+static char* script_buf = NULL;
+static size_t script_size = 0;
+static bool script_mapped = false;
+
+// Quash runs a script or a -c command instead of reading standard in
+static bool one_shot = false;
+
+// Standard in as the parser reads it when it is not a terminal
+static FILE* input_stream = NULL;
+
+// Size of the memory pool of a job read from standard in
+#define LINE_POOL_SIZE (1024)
+
+// Smallest memory pool of a whole script
+#define BATCH_POOL_SIZE (64 * 1024)
+
 /**************************************************************************
  * Private Functions
  **************************************************************************/
 static QuashState initial_state() {
+  const char* launch = getenv("QUASH_LAUNCH");
+
   return (QuashState) {
     true,
     isatty(STDIN_FILENO),
-    NULL
+    NULL,
+    launch == NULL || strcmp(launch, "fork") != 0
   };
 }
 
-// Print a prompt for a command
-static void print_prompt() {
-  bool should_free = true;
-  char* cwd = get_current_directory(&should_free);
+// Read a file that can't be mapped, like a pipe, into a buffer ending with
+// the two NUL bytes the scanner needs
+static bool read_script(int fd) {
+  size_t cap = 4096;
+  ssize_t n;
 
-  assert(cwd != NULL);
+  script_buf = malloc(cap);
+  script_size = 0;
 
-  char hostname[HOST_NAME_MAX];
+  while ((n = read(fd, script_buf + script_size, cap - script_size - 2)) != 0) {
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
 
-  // Get the hostname
-  gethostname(hostname, HOST_NAME_MAX);
+      return false;
+    }
 
-  // Remove first period and everything afterwards
-  for (int i = 0; hostname[i] != '\0'; ++i) {
-    if (hostname[i] == '.') {
-      hostname[i] = '\0';
+    script_size += n;
+
+    if (cap - script_size - 2 == 0) {
+      cap *= 2;
+      script_buf = realloc(script_buf, cap);
+    }
+  }
+
+  script_buf[script_size++] = '\0';
+  script_buf[script_size++] = '\0';
+
+  return true;
+}
+
+// Map a script file so the scanner reads it in place. The two NUL bytes the
+// scanner needs after the commands come from anonymous memory reserved past
+// the end of the file.
+static bool map_script(int fd, size_t len) {
+  script_size = len + 2;
+  script_buf = mmap(NULL, script_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (script_buf == MAP_FAILED) {
+    script_buf = NULL;
+    return false;
+  }
+
+  script_mapped = true;
+
+  // The rest of the last page of the file reads as zeros
+  return len == 0 ||
+    mmap(script_buf, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED;
+}
+
+// Load a script file for the parser
+static bool open_script(const char* path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  bool ok = fd != -1 && fstat(fd, &st) == 0;
+
+  if (ok)
+    ok = S_ISREG(st.st_mode) ? map_script(fd, st.st_size) : read_script(fd);
+
+  if (ok)
+    ok = parse_buffer(script_buf, script_size);
+  else
+    fprintf(stderr, "quash: %s: %s\n", path, strerror(errno));
+
+  if (fd != -1)
+    close(fd);
+
+  return ok;
+}
+
+static void destroy_script() {
+  if (script_mapped)
+    munmap(script_buf, script_size);
+  else
+    free(script_buf);
+
+  script_buf = NULL;
+  script_size = 0;
+  script_mapped = false;
+}
+
+// Read standard in for the parser. Until input arrives, exited children are
+// reaped and the output of jobs is drained, which also enforces timeouts.
+static ssize_t __read_input(void* cookie, char* buf, size_t size) {
+  struct pollfd fds[2] = {
+    { STDIN_FILENO, POLLIN, 0 },
+    { get_job_event_fd(), POLLIN, 0 }
+  };
+
+  while (true) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+
+      break;
+    }
+
+    // Hang ups and errors are left to read() to report
+    if (fds[0].revents != 0)
       break;
+
+    // Finished jobs are reported before the next job like any other time
+    reap_children();
+  }
+
+  return read(STDIN_FILENO, buf, size);
+}
+
+// Without a terminal the parser would block in stdio reading standard in, so
+// it reads through __read_input() instead
+static void init_input_stream() {
+  cookie_io_functions_t io = { .read = __read_input };
+
+  input_stream = fopencookie(NULL, "r", io);
+
+  if (input_stream != NULL)
+    parse_stream(input_stream);
+}
+
+static void destroy_input_stream() {
+  if (input_stream != NULL)
+    fclose(input_stream);
+
+  input_stream = NULL;
+}
+
+// Load all of standard in for the parser. If that fails, the parser goes on
+// reading standard in itself.
+static void read_standard_in() {
+  if (read_script(STDIN_FILENO) && parse_buffer(script_buf, script_size))
+    return;
+
+  perror("quash: standard input");
+  destroy_script();
+}
+
+// Choose where commands come from: `-c COMMAND [NAME [ARG]...]`, a script
+// `FILE [ARG]...` or standard in. Returns false on a usage error.
+static bool init_input(int argc, char** argv) {
+  // $0 is quash itself unless a script is named
+  state.params = argv;
+  state.num_params = 1;
+
+  if (argc < 2)
+    return true;
+
+  if (strcmp(argv[1], "-c") == 0) {
+    if (argc < 3) {
+      fprintf(stderr, "usage: quash [-c COMMAND [NAME [ARG]...] | FILE [ARG]...]\n");
+      return false;
+    }
+
+    parse_string(argv[2]);
+
+    // Like other shells, the word after the command becomes $0
+    if (argc > 3) {
+      state.params = argv + 3;
+      state.num_params = argc - 3;
     }
   }
+  else {
+    if (!open_script(argv[1]))
+      return false;
+
+    state.params = argv + 1;
+    state.num_params = argc - 1;
+  }
+
+  one_shot = true;
+  state.is_a_tty = false;
+
+  return true;
+}
+
+// Look up the parts of the prompt that don't change while quash runs
+static void init_prompt() {
+  char hostname[HOST_NAME_MAX + 1] = "";
+
+  gethostname(hostname, sizeof(hostname));
+
+  // Remove first period and everything afterwards
+  hostname[strcspn(hostname, ".")] = '\0';
+  state.prompt_host = strdup(hostname);
+
+  // getlogin() may have to read utmp, so it is only asked once
+  const char* user = getlogin();
+
+  if (user == NULL) {
+    struct passwd* pw = getpwuid(geteuid());
+    user = (pw != NULL) ? pw->pw_name : "?";
+  }
+
+  state.prompt_user = strdup(user);
+}
+
+// Remember the last directory of the working directory for the prompt
+static void set_prompt_directory(const char* cwd) {
+  const char* last_dir = cwd;
 
-  char* last_dir = cwd;
   // Show only last directory
   for (int i = 0; cwd[i] != '\0'; ++i) {
     if (cwd[i] == '/' && cwd[i + 1] != '\0') {
@@ -63,15 +274,143 @@ static void print_prompt() {
     }
   }
 
-  char* username = getlogin();
+  free(state.prompt_dir);
+  state.prompt_dir = strdup(last_dir);
+  state.prompt_len = 0;
+}
+
+// Ask the kernel for the working directory once. From then on cd keeps track
+// of it.
+static void init_working_directory() {
+  char* cwd = getcwd(NULL, 0);
 
-  // print the prompt
-  printf("[QUASH - %s@%s %s]$ ", username, hostname, last_dir);
+  // The directory may have been removed under quash
+  if (cwd == NULL)
+    cwd = strdup(".");
 
+  set_working_directory(strdup(cwd), cwd);
+}
+
+static void destroy_prompt() {
+  free(state.logical_cwd);
+  free(state.physical_cwd);
+  free(state.prompt_user);
+  free(state.prompt_host);
+  free(state.prompt_dir);
+  free(state.prompt);
+}
+
+// Print a prompt for a command
+static void print_prompt() {
+  if (state.prompt_len == 0) {
+    int len;
+
+    // Grow the buffer until the whole prompt fits
+    while ((len = snprintf(state.prompt, state.prompt_cap, "[QUASH - %s@%s %s]$ ",
+                           state.prompt_user, state.prompt_host, state.prompt_dir)) >= (int) state.prompt_cap) {
+      state.prompt_cap = len + 1;
+      state.prompt = realloc(state.prompt, state.prompt_cap);
+    }
+
+    state.prompt_len = len;
+  }
+
+  // Anything printf buffered has to come out before the prompt
   fflush(stdout);
 
-  if (should_free)
-    free(cwd);
+  if (write(STDOUT_FILENO, state.prompt, state.prompt_len) == -1 && errno != EPIPE)
+    perror("ERROR: Failed to print the prompt");
+}
+
+// Wait for a line of input. Background jobs that finish in the meantime are
+// reported right away, followed by a fresh prompt.
+static void wait_for_input() {
+  struct pollfd fds[2] = {
+    { STDIN_FILENO, POLLIN, 0 },
+    { get_job_event_fd(), POLLIN, 0 }
+  };
+
+  while (true) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+
+      return;
+    }
+
+    // Hang ups and errors are left to the parser to notice
+    if (fds[0].revents != 0)
+      return;
+
+    if (reap_children()) {
+      putchar('\n');
+      check_jobs_bg_status();
+      print_prompt();
+    }
+  }
+}
+
+// Check if the whole input should be parsed before running any of it. Scripts
+// and -c commands always are. Standard in only is when QUASH_BATCH asks for
+// it, since whatever feeds quash may be waiting on the output of the jobs.
+static bool use_batch_mode() {
+  if (one_shot)
+    return true;
+
+  const char* batch = getenv("QUASH_BATCH");
+
+  return !state.is_a_tty && batch != NULL && *batch != '\0' && strcmp(batch, "0") != 0;
+}
+
+// Run a parsed job. Only background jobs show their command string, so it is
+// only built for them.
+static void run_parsed_script(CommandHolder* script) {
+  state.parsed_str = (script[0].flags & BACKGROUND) ? stringify_script(script) : NULL;
+
+  run_script(script);
+}
+
+// Run the input a line at a time, each with a memory pool of its own
+static void run_lines() {
+  if (!is_tty())
+    init_input_stream();
+
+  while (is_running()) {
+    if (is_tty()) {
+      print_prompt();
+      wait_for_input();
+    }
+
+    initialize_memory_pool(LINE_POOL_SIZE);
+    CommandHolder* script = parse(&state);
+
+    if (script != NULL)
+      run_parsed_script(script);
+
+    destroy_memory_pool();
+  }
+}
+
+// Parse the whole input into a single memory pool and then run it. Each job is
+// expanded right before it runs so that it sees what the jobs before it did.
+static void run_batch() {
+  // Standard in is read up front like a script file
+  if (!one_shot)
+    read_standard_in();
+
+  initialize_memory_pool((script_size > BATCH_POOL_SIZE) ? script_size : BATCH_POOL_SIZE);
+
+  CommandHolder** scripts = parse_all(&state);
+
+  // Reaching the end of the input stopped the parser, not the jobs
+  state.running = true;
+
+  for (size_t i = 0; scripts[i] != NULL && is_running(); ++i) {
+    expand_script(scripts[i]);
+    run_parsed_script(scripts[i]);
+  }
+
+  destroy_memory_pool();
 }
 
 /**************************************************************************
@@ -82,9 +421,40 @@ bool is_running() {
   return state.running;
 }
 
+// Check which backend creates processes for generic commands
+bool use_posix_spawn() {
+  return state.use_spawn;
+}
+
+// Get the working directory as reached with cd
+const char* get_logical_directory() {
+  return state.logical_cwd;
+}
+
+// Get the working directory with symbolic links resolved
+const char* get_physical_directory() {
+  return state.physical_cwd;
+}
+
+// Replace the working directory quash keeps track of
+void set_working_directory(char* logical, char* physical) {
+  free(state.logical_cwd);
+  free(state.physical_cwd);
+
+  state.logical_cwd = logical;
+  state.physical_cwd = physical;
+
+  set_prompt_directory(logical);
+}
+
+// Get $0 to $9
+const char* get_positional_parameter(int n) {
+  return (n < state.num_params) ? state.params[n] : NULL;
+}
+
 // Get a copy of the string
 char* get_command_string() {
-  return strdup(state.parsed_str);
+  return (state.parsed_str != NULL) ? strdup(state.parsed_str) : NULL;
 }
 
 // Check if Quash is receiving input from the command line or not
@@ -109,6 +479,14 @@ void end_main_loop() {
 int main(int argc, char** argv) {
   state = initial_state();
 
+  // The scanner lets go of its input before the input is released
+  atexit(destroy_script);
+  atexit(destroy_input_stream);
+  atexit(destroy_parser);
+
+  if (!init_input(argc, argv))
+    return 2;
+
   if (is_tty()) {
     puts("Welcome to Quash!");
     puts("Type \"exit\" or \"quit\" to quit");
@@ -116,24 +494,35 @@ int main(int argc, char** argv) {
     fflush(stdout);
   }
 
-
-  atexit(destroy_parser);
   atexit(destroy_memory_pool);
+  atexit(destroy_path_cache);
+  atexit(destroy_variables);
+  atexit(destroy_job_table);
+  atexit(destroy_prompt);
+
+  init_working_directory();
+
+  if (is_tty())
+    init_prompt();
+
+  // Quash hands the terminal to foreground jobs and must be able to take it
+  // back from the background
+  if (is_tty())
+    signal(SIGTTOU, SIG_IGN);
   
 
   // Main execution loop
-  while (is_running()) {
-    if (is_tty())
-      print_prompt();
+  if (use_batch_mode())
+    run_batch();
+  else
+    run_lines();
 
-    initialize_memory_pool(1024);
-    CommandHolder* script = parse(&state);
+  wait_for_pending_jobs();
 
-    if (script != NULL)
-      run_script(script);
-      
-    destroy_memory_pool();
-  }
+  // Tools running a script or a command want to know how it went. Input that
+  // did not parse fails like it does in other shells.
+  if (!one_shot)
+    return EXIT_SUCCESS;
 
-  return EXIT_SUCCESS;
+  return had_syntax_error() ? 2 : get_last_exit_status();
 }
@@ -21,7 +21,28 @@ typedef struct QuashState {
   bool is_a_tty;    /**< Indicates if the shell is receiving input from a file
                      * or the command line */
   char* parsed_str; /**< Holds a string representing the parsed structure of the
-                     * command input from the command line */
+                     * command input from the command line. Only built for
+                     * background jobs, NULL otherwise */
+  bool use_spawn;   /**< Launch generic commands with posix_spawn(3) rather
+                     * than fork(2). Selected at startup with the QUASH_LAUNCH
+                     * environment variable ("spawn" or "fork") */
+  char** params;    /**< The positional parameters. The first one is $0, the
+                     * name of the script or of quash itself */
+  int num_params;   /**< Number of strings in @a params */
+  char* logical_cwd;  /**< Working directory as reached with cd, through any
+                       * symbolic links. Exported as PWD */
+  char* physical_cwd; /**< Working directory with every symbolic link
+                       * resolved */
+  char* prompt_user; /**< User name shown in the prompt. Looked up once */
+  char* prompt_host; /**< Host name shown in the prompt up to the first
+                      * period. Looked up once */
+  char* prompt_dir;  /**< Last component of the working directory shown in
+                      * the prompt. Updated by the cd builtin */
+  char* prompt;      /**< The rendered prompt, reused until one of its parts
+                      * changes */
+  size_t prompt_len; /**< Length of @a prompt or 0 if it must be rendered
+                      * again */
+  size_t prompt_cap; /**< Capacity of @a prompt */
 } QuashState;
 
 /**
@@ -31,12 +52,59 @@ typedef struct QuashState {
  */
 bool is_tty();
 
+/**
+ * @brief Check if generic commands should be launched with posix_spawn(3)
+ *
+ * posix_spawn(3) avoids duplicating the page tables of quash for every
+ * process. The fork(2) path is kept as a fallback and is still used for the
+ * builtins that have to run inside a copy of quash.
+ *
+ * @return True if the posix_spawn(3) backend is selected and false if every
+ * process should be created with fork(2)
+ */
+bool use_posix_spawn();
+
+/**
+ * @brief Get the working directory as reached with cd
+ *
+ * @return The logical working directory, owned by quash
+ */
+const char* get_logical_directory();
+
+/**
+ * @brief Get the working directory with every symbolic link resolved
+ *
+ * @return The physical working directory, owned by quash
+ */
+const char* get_physical_directory();
+
+/**
+ * @brief Record a new working directory once quash has changed into it
+ *
+ * @param logical The logical path of the directory. Quash takes ownership of
+ * it.
+ *
+ * @param physical The resolved path of the directory. Quash takes ownership
+ * of it.
+ */
+void set_working_directory(char* logical, char* physical);
+
+/**
+ * @brief Get a positional parameter
+ *
+ * @param n The number of the parameter. 0 is the name of the script.
+ *
+ * @return The parameter or NULL if there are fewer than @a n
+ */
+const char* get_positional_parameter(int n);
+
 /**
  * @brief Get a deep copy of the current command string
  *
  * @note The free function must be called on the result eventually
  *
- * @return A copy of the command string
+ * @return A copy of the command string or NULL if the current job runs in the
+ * foreground and has none
  */
 char* get_command_string();
 
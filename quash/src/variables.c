@@ -0,0 +1,158 @@
+/**
+ * @file variables.c
+ *
+ * @brief Implements Quash's table of shell variables
+ */
+
+#include "variables.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+
+extern char** environ;
+
+// Each entry's value holds the whole "NAME=value" string so the envp array
+// can point straight at it. The count of an entry is EXPORTED when it goes
+// into the envp array.
+static HashTable table = { NULL, 0, 0 };
+
+#define EXPORTED (1)
+
+static char** envp = NULL;
+static size_t num_exported = 0;
+static bool envp_dirty = true;
+
+// Store a "NAME=value" string under the name it starts with
+static HashEntry* __insert_pair(const char* name, size_t name_len, const char* value) {
+  size_t value_len = strlen(value);
+  char* pair = malloc(name_len + value_len + 2);
+
+  memcpy(pair, name, name_len);
+  pair[name_len] = '\0';
+  memcpy(pair + name_len + 1, value, value_len + 1);
+
+  HashEntry* e = insert_hash_table(&table, pair, NULL);
+
+  // The table frees values with free() so it can take ownership of the pair
+  pair[name_len] = '=';
+  free(e->value);
+  e->value = pair;
+
+  if (e->count & EXPORTED)
+    envp_dirty = true;
+
+  return e;
+}
+
+// Start or stop handing a variable to new processes
+static void __set_exported(HashEntry* e, bool exported) {
+  if (exported == (bool) (e->count & EXPORTED))
+    return;
+
+  e->count ^= EXPORTED;
+  num_exported += exported ? 1 : -1;
+  envp_dirty = true;
+}
+
+// Import the environment quash was started with the first time the table is
+// used
+static HashTable* __table() {
+  if (table.buckets == NULL) {
+    init_hash_table(&table, 128);
+
+    for (char** env = environ; *env != NULL; ++env) {
+      const char* eq = strchr(*env, '=');
+
+      if (eq != NULL)
+        __set_exported(__insert_pair(*env, eq - *env, eq + 1), true);
+    }
+  }
+
+  return &table;
+}
+
+const char* lookup_variable(const char* name) {
+  HashEntry* e = lookup_hash_table(__table(), name);
+
+  if (e == NULL)
+    return NULL;
+
+  return e->value + strlen(e->key) + 1;
+}
+
+const char* lookup_n_variable(const char* name, size_t len) {
+  HashEntry* e = lookup_n_hash_table(__table(), name, len);
+
+  if (e == NULL)
+    return NULL;
+
+  return e->value + len + 1;
+}
+
+bool is_exported_variable(const char* name) {
+  HashEntry* e = lookup_hash_table(__table(), name);
+
+  return e != NULL && (e->count & EXPORTED);
+}
+
+void set_variable(const char* name, const char* value) {
+  __table();
+  __insert_pair(name, strlen(name), value);
+}
+
+void export_variable(const char* name, const char* value) {
+  __table();
+  __set_exported(__insert_pair(name, strlen(name), value), true);
+}
+
+void unexport_variable(const char* name) {
+  HashEntry* e = lookup_hash_table(__table(), name);
+
+  if (e != NULL)
+    __set_exported(e, false);
+}
+
+void unset_variable(const char* name) {
+  HashEntry* e = lookup_hash_table(__table(), name);
+
+  if (e == NULL)
+    return;
+
+  __set_exported(e, false);
+  remove_hash_table(&table, name);
+}
+
+static char** fill_pos;
+
+static void __collect_pair(HashEntry* e) {
+  if (e->count & EXPORTED)
+    *fill_pos++ = e->value;
+}
+
+char** get_envp() {
+  __table();
+
+  if (envp_dirty) {
+    free(envp);
+    envp = malloc((num_exported + 1) * sizeof(char*));
+
+    fill_pos = envp;
+    apply_hash_table(&table, __collect_pair);
+    *fill_pos = NULL;
+
+    envp_dirty = false;
+  }
+
+  return envp;
+}
+
+void destroy_variables() {
+  free(envp);
+  envp = NULL;
+  num_exported = 0;
+  envp_dirty = true;
+
+  destroy_hash_table(&table);
+}
@@ -0,0 +1,99 @@
+/**
+ * @file variables.h
+ *
+ * @brief Quash's own table of shell variables
+ *
+ * The table is filled from the environment quash was started with, and those
+ * variables are exported. Variables assigned with a plain `NAME=value` stay
+ * local to quash until they are exported. Only exported variables make it
+ * into the envp array handed to exec, which is only rebuilt after one of them
+ * changes.
+ */
+
+#ifndef SRC_VARIABLES_H
+#define SRC_VARIABLES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Get the value of a variable
+ *
+ * @param name The name of the variable
+ *
+ * @return The value of the variable or NULL if it is not set. The string is
+ * owned by the table and is valid until the variable next changes.
+ */
+const char* lookup_variable(const char* name);
+
+/**
+ * @brief Get the value of a variable whose name is not NULL terminated
+ *
+ * @param name The start of the name of the variable
+ *
+ * @param len The length of the name
+ *
+ * @return The value of the variable or NULL if it is not set. The string is
+ * owned by the table and is valid until the variable next changes.
+ */
+const char* lookup_n_variable(const char* name, size_t len);
+
+/**
+ * @brief Check if a variable is exported to new processes
+ *
+ * @param name The name of the variable
+ *
+ * @return True if the variable is set and exported
+ */
+bool is_exported_variable(const char* name);
+
+/**
+ * @brief Set a variable
+ *
+ * A variable that is already exported stays exported. A new variable is
+ * local to quash.
+ *
+ * @param name The name of the variable
+ *
+ * @param value The value to store in the variable
+ */
+void set_variable(const char* name, const char* value);
+
+/**
+ * @brief Set a variable and export it to the environment of new processes
+ *
+ * @param name The name of the variable
+ *
+ * @param value The value to store in the variable
+ */
+void export_variable(const char* name, const char* value);
+
+/**
+ * @brief Stop exporting a variable while keeping its value
+ *
+ * @param name The name of the variable
+ */
+void unexport_variable(const char* name);
+
+/**
+ * @brief Remove a variable
+ *
+ * @param name The name of the variable
+ */
+void unset_variable(const char* name);
+
+/**
+ * @brief Get an environment array for the exec family of functions
+ *
+ * The array is cached and only rebuilt after a variable has changed.
+ *
+ * @return A NULL terminated array of "NAME=value" strings owned by the table
+ */
+char** get_envp();
+
+/**
+ * @brief Free the memory held by the variable table
+ */
+void destroy_variables();
+
+#endif